@@ -0,0 +1,63 @@
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#pragma once
+
+// number of records written (and fdatasync'ed) together
+static const size_t kDefaultJournalGroupSize = 256;
+// number of records after which the journal is folded into the metadata files
+static const size_t kDefaultJournalCheckpointInterval = 64 * 1024;
+
+struct JournalRecord {
+    uint64_t block_id;
+    int64_t offset;
+    uint32_t file_id;
+    uint32_t checksum;  // of the fields above, detects torn records
+
+    JournalRecord();
+    JournalRecord(uint64_t block_id, uint32_t file_id, int64_t offset);
+
+    bool is_valid() const;
+};
+
+// Append-only log of block allocations. Records are buffered and written in
+// groups, each group followed by an fdatasync; a record is durable once its
+// group is committed. The journal is emptied after every checkpoint of the
+// StorageMetadata and BlockMetadata files.
+class AllocationJournal {
+    const std::filesystem::path journal_path;
+    int fd;
+    const size_t group_size;
+    std::vector<JournalRecord> pending;
+    size_t file_size;
+
+    AllocationJournal(const std::filesystem::path& journal_path, int fd,
+                      size_t group_size, size_t file_size);
+
+  public:
+    static std::filesystem::path get_journal_path(
+        const std::filesystem::path& path);
+    static absl::StatusOr<std::unique_ptr<AllocationJournal>> open(
+        const std::filesystem::path& path,
+        size_t group_size = kDefaultJournalGroupSize);
+    // records of the journal up to the first torn or corrupted one
+    static absl::StatusOr<std::vector<JournalRecord>> read_records(
+        const std::filesystem::path& path);
+    AllocationJournal(const AllocationJournal&) = delete;
+    AllocationJournal& operator=(const AllocationJournal&) = delete;
+    ~AllocationJournal();  // commits what is pending
+
+    // commits the group as soon as it is full
+    absl::Status append(const JournalRecord& record);
+    absl::Status commit();
+    // drops all the records, called once they are checkpointed
+    absl::Status truncate();
+
+    size_t get_pending_count() const;
+};
@@ -0,0 +1,59 @@
+#include <predicate.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#pragma once
+
+// how a block is laid out on its device
+enum class BlockEncoding : uint8_t {
+    Plain,
+    // value - reference, bit-packed
+    FrameOfReference,
+    // index into a sorted dictionary of the distinct values, bit-packed
+    Dictionary
+};
+
+// An encoded block starts with this header. FrameOfReference follows it with
+// the codes, Dictionary with dictionary_size ints and then the codes. Codes
+// are bit_width bits each, packed from the lowest bit of the first byte on,
+// and kEncodedBlockSlack bytes after them are readable, so that a code can
+// always be fetched with one unaligned load.
+struct EncodedBlockHeader {
+    BlockEncoding encoding;
+    uint8_t bit_width;
+    uint16_t reserved;
+    uint32_t value_count;
+    int32_t reference;  // FrameOfReference only
+    uint32_t dictionary_size;
+};
+
+static const size_t kEncodedBlockSlack = 8;
+// dictionaries with more values than this are not tried
+static const size_t kMaxDictionarySize = 1 << 16;
+
+// Encodes values into encoded with FrameOfReference or Dictionary, whichever
+// is smaller, and returns the number of bytes used. Returns 0, leaving the
+// values plain, if neither fits into encoded.
+size_t encode_block(std::span<const int> values, std::span<char> encoded);
+
+// DataLossError if the header is corrupt or the block is truncated
+absl::StatusOr<BlockEncoding> get_block_encoding(std::span<const char> encoded);
+
+// values must have room for the value count of the block
+absl::Status decode_block(std::span<const char> encoded, std::span<int> values);
+
+// less_than_bitmap over an encoded block, without decoding it: the bound is
+// turned into a threshold on the codes (bound - reference, or the position of
+// bound in the dictionary) and the codes are unpacked and compared 8 or 16
+// at a time. value_count is the number of values of a block and bitmap must
+// have room for them. Returns the number of passed values, or DataLossError
+// for a corrupt or truncated block, or one holding another number of values.
+absl::StatusOr<size_t> encoded_less_than_bitmap(
+    std::span<const char> encoded, size_t value_count, int bound,
+    std::span<uint64_t> bitmap,
+    PredicateKernel kernel = best_predicate_kernel());
@@ -0,0 +1,153 @@
+#include <storage_engine.h>
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#pragma once
+
+enum class TraceOperation : uint8_t { Read, Write };
+
+// one block read or write of a StorageEngine
+struct TraceRecord {
+    uint64_t timestamp;  // start, in nanoseconds since the recorder opened
+    uint64_t block_id;
+    uint32_t latency;    // nanoseconds, saturated
+    uint16_t device;
+    uint16_t thread;     // ring of the recording thread, see TraceRecorder
+    TraceOperation operation;
+    uint8_t reserved[7];
+};
+static_assert(sizeof(TraceRecord) == 32);
+
+// A trace file is this header followed by TraceRecords, in the order they
+// were flushed: per thread by timestamp, but threads interleave by flush.
+struct TraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+static const uint32_t kTraceMagic = 0x54524345;  // "TRCE"
+static const uint32_t kTraceVersion = 1;
+// records a thread can have pending before new ones are dropped
+static const size_t kDefaultTraceRingCapacity = 1 << 14;
+// threads recording at the same time at most; records of any more are dropped
+static const size_t kMaxTraceRings = 256;
+static const std::chrono::milliseconds kDefaultTraceFlushInterval(100);
+
+// Records block accesses into a trace file. Every recording thread leases
+// its own single-producer ring, so record() is a few relaxed stores and one
+// release store; it never blocks, and when the ring of the thread is full
+// the record is dropped and counted. A thread takes a ring on its first
+// record with a lock-free scan for one given back, and gives it back when it
+// exits, so threads that come and go (like the ones of write_blocks) reuse
+// the rings of the ones before them. A background thread drains the rings
+// into the file every flush interval.
+class TraceRecorder {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    static absl::StatusOr<std::shared_ptr<TraceRecorder>> open(
+        const std::filesystem::path& path,
+        size_t ring_capacity = kDefaultTraceRingCapacity,
+        std::chrono::milliseconds flush_interval = kDefaultTraceFlushInterval);
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+    ~TraceRecorder();  // stops the flushing and flushes what is left
+
+    void record(TraceOperation operation, uint64_t block_id, size_t device,
+                Clock::time_point start, Clock::time_point end);
+    // drains every ring into the file now
+    absl::Status flush();
+
+    uint64_t get_recorded_count() const;
+    uint64_t get_dropped_count() const;
+    // rings allocated so far, at most the number of threads that recorded
+    // at the same time
+    size_t get_ring_count() const;
+    // error of the last failed background flush, OK if there was none
+    absl::Status get_flush_status();
+
+  private:
+    struct Ring;
+    struct RingSlot;
+    struct RingLease;
+
+    const uint64_t id;  // tells recorders apart in the per-thread ring lease
+    const Clock::time_point epoch;
+    const size_t ring_capacity;
+    std::atomic<uint64_t> recorded_count{0};
+
+    // kMaxTraceRings slots, filled in order; ring_slot_count counts the
+    // claimed ones and may run past kMaxTraceRings
+    const std::unique_ptr<RingSlot[]> ring_slots;
+    std::atomic<size_t> ring_slot_count{0};
+    std::atomic<uint64_t> ringless_dropped{0};  // no ring was left
+
+    std::mutex flush_mutex;  // guards the fields below
+    std::ofstream out;
+    std::vector<TraceRecord> flush_buffer;
+    absl::Status flush_status;
+    std::condition_variable flush_cv;
+    bool flush_stopped = false;
+    std::thread flush_thread;
+
+    TraceRecorder(std::ofstream out, size_t ring_capacity);
+    Ring* get_ring();  // nullptr if all kMaxTraceRings are leased
+    absl::Status flush_locked();
+};
+
+// records of a trace file, sorted by timestamp
+absl::StatusOr<std::vector<TraceRecord>> read_trace(
+    const std::filesystem::path& path);
+
+enum class ReplaySpeed {
+    Original,  // with the gaps between the records of the trace
+    Scaled,    // with the gaps divided by speed_factor
+    Maximum    // without gaps
+};
+
+struct ReplayOptions {
+    ReplaySpeed speed = ReplaySpeed::Original;
+    double speed_factor = 1.0;
+    size_t thread_number = 1;  // accesses in flight at most
+    // writes put zeros into the block; without this they are skipped
+    bool replay_writes = false;
+};
+
+struct ReplayResult {
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t skipped = 0;  // writes not replayed, blocks missing in the store
+    uint64_t failed = 0;
+    double elapsed = 0;  // seconds
+    // how far the latest access started behind its schedule, in seconds
+    double max_lag = 0;
+    // bucket counts of the access latencies in nanoseconds, see
+    // LatencyHistogram and DeviceStatsSnapshot::percentile
+    std::vector<uint64_t> latency;
+};
+
+// Re-issues a trace (sorted by timestamp, as read_trace returns it) against
+// a store: block ids are looked up in that store, so the same trace can be
+// compared across stores with different placements. Records are taken in
+// order by thread_number threads, each one waiting for the start time of its
+// record under the chosen speed before issuing it.
+ReplayResult replay_trace(StorageEngine& storage_engine,
+                          std::span<const TraceRecord> trace,
+                          const ReplayOptions& options = {});
@@ -0,0 +1,46 @@
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#pragma once
+
+// default number of preallocated buffers in the pool of a StorageEngine
+static const size_t kDefaultBufferCount = 1024;
+
+// Preallocated arena of O_DIRECT-aligned block buffers. Buffers are handed
+// out by acquire() and given back by release(); when the arena is exhausted
+// acquire() falls back to aligned_alloc, and release() frees those buffers.
+class BufferPool {
+    const size_t buffer_size;
+    const size_t buffer_count;
+    char* arena;
+    size_t arena_size;
+    bool hugepages;
+
+    std::mutex mutex;
+    std::vector<char*> free_buffers;
+
+    BufferPool(size_t buffer_size, size_t buffer_count);
+
+  public:
+    // with use_hugepages the arena is backed by explicit hugepages when the
+    // system has them reserved, and by transparent hugepages otherwise
+    static absl::StatusOr<std::shared_ptr<BufferPool>> create(
+        size_t buffer_size, size_t buffer_count = kDefaultBufferCount,
+        bool use_hugepages = false);
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    ~BufferPool();
+
+    char* acquire();
+    void release(char* buffer);
+
+    size_t get_buffer_size() const;
+    size_t get_buffer_count() const;
+    size_t get_free_buffer_count();
+    bool uses_hugepages() const;
+};
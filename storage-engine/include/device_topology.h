@@ -0,0 +1,46 @@
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#pragma once
+
+struct DeviceConfig {
+    std::string path;  // directory the device file of a store is created in
+    size_t capacity;   // in bytes, 0 means unlimited
+    double weight;     // relative bandwidth
+
+    DeviceConfig(const std::string& path, size_t capacity = 0,
+                 double weight = 1.0);
+};
+
+// Devices a store is spread over. Loaded from a config file with one device
+// per line:
+//     <path>,<capacity in bytes, 0 for unlimited>,<weight>
+// empty lines and lines starting with '#' are skipped.
+class DeviceTopology {
+    std::vector<DeviceConfig> devices;
+
+    explicit DeviceTopology(const std::vector<DeviceConfig>& devices);
+
+  public:
+    // disk_pathes, identical devices without capacity limits
+    static DeviceTopology default_topology();
+    static absl::StatusOr<DeviceTopology> create(
+        const std::vector<DeviceConfig>& devices);
+    static absl::StatusOr<DeviceTopology> load(
+        const std::filesystem::path& config_path);
+
+    size_t size() const;
+    const std::vector<DeviceConfig>& get_devices() const;
+    const DeviceConfig& get_device(size_t file_id) const;
+    bool is_uniform() const;
+
+    // One period of a smooth weighted round robin over the devices: every
+    // device occurs in proportion to its weight and occurrences of a device
+    // are spread evenly. With equal weights it is 0, 1, ..., size() - 1.
+    std::vector<size_t> placement_cycle() const;
+};
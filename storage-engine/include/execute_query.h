@@ -1,12 +1,63 @@
 #include <fcntl.h>
+#include <io_scheduler.h>
+#include <morsel_executor.h>
 #include <storage_engine.h>
+#include <table.h>
 #include <unistd.h>
+#include <value_type.h>
 
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
 #include "absl/status/statusor.h"
 
+// default number of blocks of each column in flight in
+// pipelined_execute_query
+static const size_t kDefaultPrefetchDistance = 16;
+
+// SELECT SUM(B) WHERE A < upper_bound, with col_a[t] and col_b[t] holding
+// the same rows: column-B blocks are read only if a row of their column-A
+// block passes, and summed under the selection bitmap into a 64-bit
+// accumulator. Runs on thread_number threads (see MorselExecutor); time is
+// set to the wall time of the query in milliseconds.
+absl::StatusOr<int64_t> execute_query(
+    StorageEngine& storage_engine,
+    long long& time,
+    const std::vector<StorageEngine::BlockId>& col_a,
+    const std::vector<StorageEngine::BlockId>& col_b,
+    int upper_bound,
+    size_t thread_number = 1
+);
+
+// execute_query over typed columns of the same row count, whose values have
+// the same size (so that block t of both holds the same rows); the padding
+// of the last block is not looked at. Zone maps are used for int32_t
+// column A only. Instantiated for every pair of int32_t, float and int64_t.
+template <typename A, typename B>
+absl::StatusOr<SumType<B>> execute_query(
+    const Column<A>& col_a,
+    const Column<B>& col_b,
+    A upper_bound,
+    size_t thread_number = 1
+);
+
+// execute_query as a two-stage pipeline on a single thread, with the reads
+// going through io_scheduler: up to prefetch_distance column-A reads are in
+// flight while the filter runs, and the column-B read of a position is
+// issued as soon as its mask is known, up to prefetch_distance of them.
+// Device time and filter time overlap instead of alternating.
+absl::StatusOr<int64_t> pipelined_execute_query(
+    StorageEngine& storage_engine,
+    IoScheduler& io_scheduler,
+    const std::vector<StorageEngine::BlockId>& col_a,
+    const std::vector<StorageEngine::BlockId>& col_b,
+    int upper_bound,
+    size_t prefetch_distance = kDefaultPrefetchDistance
+);
+
+// counts per device the column-B blocks the query has to load; column-A
+// blocks whose zone map decides the predicate are not read
 absl::Status counting_execute_query(
     StorageEngine& storage_engine,
     const std::vector<StorageEngine::BlockId>& col_a,
@@ -14,3 +65,26 @@ absl::Status counting_execute_query(
     int upper_bound,
     std::vector<size_t>& cnt
 );
+
+// counting_execute_query on thread_number threads; positions are split into
+// morsels by the device of their column-A block, see MorselExecutor
+absl::Status parallel_counting_execute_query(
+    StorageEngine& storage_engine,
+    const std::vector<StorageEngine::BlockId>& col_a,
+    const std::vector<StorageEngine::BlockId>& col_b,
+    int upper_bound,
+    std::vector<size_t>& cnt,
+    size_t thread_number,
+    size_t morsel_size = kDefaultMorselSize
+);
+
+// runs the query like counting_execute_query, but counts the loads of every
+// block instead of every device; the counts can be fed to
+// StorageEngine::set_block_heat
+absl::Status block_counting_execute_query(
+    StorageEngine& storage_engine,
+    const std::vector<StorageEngine::BlockId>& col_a,
+    const std::vector<StorageEngine::BlockId>& col_b,
+    int upper_bound,
+    std::vector<size_t>& block_cnt
+);
@@ -0,0 +1,55 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#pragma once
+
+// default time after which an access counts half as much
+static const std::chrono::milliseconds kDefaultHeatHalfLife(60 * 1000);
+// number of per-block counters allocated at a time
+static const size_t kHeatChunkSize = 64 * 1024;
+
+// Always-on per-block access counters. record() is a relaxed atomic
+// increment, so concurrent readers only meet on the cache line of the
+// block's counter. Counters live in fixed chunks that never move, so
+// growing the tracker doesn't copy them, but resize() must not run
+// concurrently with record().
+//
+// Decay is applied lazily: snapshot() folds the counts collected since the
+// previous snapshot into the heat, after the heat decayed exponentially for
+// the time in between. Accesses between two snapshots are therefore treated
+// as if they happened at the later one.
+class HeatTracker {
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<std::unique_ptr<std::atomic<uint32_t>[]>> chunks;
+    size_t block_count = 0;
+
+    std::mutex mutex;  // guards the fields below
+    std::chrono::milliseconds half_life;
+    std::vector<double> heat;
+    Clock::time_point last_snapshot;
+
+  public:
+    explicit HeatTracker(
+        std::chrono::milliseconds half_life = kDefaultHeatHalfLife);
+    HeatTracker(const HeatTracker&) = delete;
+    HeatTracker& operator=(const HeatTracker&) = delete;
+
+    void resize(size_t block_count);
+    void set_half_life(std::chrono::milliseconds half_life);
+
+    void record(size_t block_id) {
+        chunks[block_id / kHeatChunkSize][block_id % kHeatChunkSize]
+            .fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // decayed access count per block
+    std::vector<double> snapshot();
+    void reset();
+    size_t size() const;
+};
@@ -0,0 +1,54 @@
+#include <storage_engine.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#pragma once
+
+// Routes block reads to the device that owns the block: every device has its
+// own submission queue served by its own worker threads, so a hot device
+// queues up on its own instead of stalling the readers of the other devices.
+class IoScheduler {
+    struct Request {
+        StorageEngine::BlockId block_id;
+        std::promise<absl::StatusOr<BlockReader>> promise;
+    };
+
+    struct DeviceQueue {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Request> requests;
+        std::atomic<size_t> depth{0};  // queued + being served
+        bool stopped = false;
+    };
+
+    const StorageEngine& storage_engine;
+    std::vector<std::unique_ptr<DeviceQueue>> queues;
+    std::vector<std::thread> workers;
+
+    void worker_loop(DeviceQueue& queue);
+
+  public:
+    IoScheduler(const StorageEngine& storage_engine,
+                size_t workers_per_device = 1);
+    IoScheduler(const IoScheduler&) = delete;
+    IoScheduler& operator=(const IoScheduler&) = delete;
+    ~IoScheduler();  // serves what is already queued, then joins the workers
+
+    std::future<absl::StatusOr<BlockReader>> submit_read(
+        StorageEngine::BlockId block_id);
+
+    size_t get_number_of_devices() const;
+    size_t get_queue_depth(size_t file_id) const;
+    std::vector<size_t> get_queue_depths() const;
+};
@@ -0,0 +1,104 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+
+#pragma once
+
+// Log-linear latency histogram in the spirit of HDR histograms: values are
+// bucketed by their power of two, and every power of two is split into
+// 2^kSubBucketBits linear sub-buckets, so a bucket is at most 1/8 of its
+// value wide. Recording is a pair of relaxed atomic increments.
+class LatencyHistogram {
+  public:
+    static constexpr size_t kSubBucketBits = 3;
+    static constexpr size_t kSubBucketCount = size_t(1) << kSubBucketBits;
+    static constexpr size_t kBucketCount = 64 * kSubBucketCount;
+
+    static size_t bucket_index(uint64_t value);
+    // largest value that falls into the bucket
+    static uint64_t bucket_upper_bound(size_t index);
+
+    void record(uint64_t value);
+    void reset();
+    std::vector<uint64_t> snapshot() const;
+    uint64_t get_sum() const;
+
+  private:
+    std::array<std::atomic<uint64_t>, kBucketCount> counts{};
+    std::atomic<uint64_t> sum{0};
+};
+
+struct DeviceStatsSnapshot {
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    int64_t in_flight = 0;
+    // bucket counts of the read and write latencies, in nanoseconds
+    std::vector<uint64_t> read_latency;
+    std::vector<uint64_t> write_latency;
+
+    // upper bound of the bucket holding the q-quantile, 0 without samples
+    static uint64_t percentile(const std::vector<uint64_t>& histogram,
+                               double q);
+};
+
+// Per-device I/O instrumentation of a StorageEngine: latency histograms,
+// bytes moved and I/Os in flight, all lock-free. A background thread can
+// append a snapshot to a CSV file at a fixed interval.
+class IoStats {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit IoStats(size_t number_of_devices);
+    IoStats(const IoStats&) = delete;
+    IoStats& operator=(const IoStats&) = delete;
+    ~IoStats();  // stops the dump
+
+    // begin_* marks an I/O in flight and returns its start time for end_*
+    Clock::time_point begin_io(size_t file_id);
+    void end_read(size_t file_id, Clock::time_point start, size_t bytes);
+    void end_write(size_t file_id, Clock::time_point start, size_t bytes);
+
+    size_t get_number_of_devices() const;
+    DeviceStatsSnapshot snapshot(size_t file_id) const;
+    std::vector<DeviceStatsSnapshot> snapshot() const;
+    void reset();
+
+    // appends one line per device, the header goes into new files only
+    absl::Status dump_csv(const std::filesystem::path& path) const;
+    void start_dump(const std::filesystem::path& path,
+                    std::chrono::milliseconds interval);
+    void stop_dump();
+    // error of the last failed periodic dump, OK if there was none
+    absl::Status get_dump_status();
+
+  private:
+    struct DeviceCounters {
+        LatencyHistogram read_latency;
+        LatencyHistogram write_latency;
+        std::atomic<uint64_t> reads{0};
+        std::atomic<uint64_t> writes{0};
+        std::atomic<uint64_t> bytes_read{0};
+        std::atomic<uint64_t> bytes_written{0};
+        std::atomic<int64_t> in_flight{0};
+    };
+
+    std::vector<std::unique_ptr<DeviceCounters>> devices;
+
+    std::mutex dump_mutex;  // guards the fields below
+    std::condition_variable dump_cv;
+    bool dump_stopped = true;
+    absl::Status dump_status;
+    std::thread dump_thread;
+};
@@ -0,0 +1,57 @@
+#include <linux/io_uring.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#pragma once
+
+// minimal io_uring wrapper on top of the raw syscalls (we don't depend on
+// liburing), only what the batched read path needs
+class IoUring {
+    int ring_fd;
+
+    void* sq_ring_ptr;
+    size_t sq_ring_size;
+    void* cq_ring_ptr;
+    size_t cq_ring_size;
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_ring_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_ring_mask;
+    io_uring_cqe* cqes;
+
+    unsigned sq_entries;
+    unsigned to_submit;
+
+    IoUring();
+    void release();
+
+  public:
+    static absl::StatusOr<IoUring> create(unsigned entries);
+    IoUring(IoUring&&);
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+    ~IoUring();
+
+    // returns false if the submission queue is full
+    bool queue_read(int fd, void* buffer, unsigned length, long offset,
+                    uint64_t user_data);
+
+    // submits everything queued so far and waits for at least wait_nr
+    // completions
+    absl::Status submit_and_wait(unsigned wait_nr);
+
+    // pops one completion, returns false if the completion queue is empty
+    bool pop_completion(uint64_t& user_data, int& result);
+
+    unsigned get_entries() const;
+};
@@ -0,0 +1,53 @@
+#include <storage_engine.h>
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "absl/status/status.h"
+
+#pragma once
+
+// number of query positions (pairs of col_a/col_b blocks) per morsel
+static const size_t kDefaultMorselSize = 16;
+
+// Splits the positions 0..n-1 of a query into morsels grouped by the device
+// of the block that drives each position, and runs them on a pool of
+// threads. Worker w calls device w % number_of_devices its home: it drains
+// the home device's morsels first, then steals from the other devices in
+// turn. Morsels are claimed with an atomic cursor per device, so home
+// workers and thieves never block each other.
+class MorselExecutor {
+  public:
+    using Task = std::function<absl::Status(size_t worker,
+                                            std::span<const size_t> positions)>;
+
+    MorselExecutor(const StorageEngine& storage_engine,
+                   std::span<const StorageEngine::BlockId> driving_blocks,
+                   size_t morsel_size = kDefaultMorselSize);
+
+    // calls task for every morsel on thread_number threads, returns the
+    // first error; no new morsels are started after an error
+    absl::Status run(size_t thread_number, const Task& task);
+
+    size_t get_morsel_count() const;
+    // morsels that ran on a worker of another device in the last run
+    size_t get_stolen_count() const;
+
+  private:
+    struct DeviceMorsels {
+        std::vector<size_t> positions;
+        size_t morsel_count = 0;
+        std::atomic<size_t> next{0};
+    };
+
+    const size_t morsel_size;
+    std::vector<std::unique_ptr<DeviceMorsels>> devices;
+    std::atomic<size_t> stolen_count{0};
+
+    // claims the next morsel of the device, empty once it is drained
+    std::span<const size_t> claim(size_t file_id);
+};
@@ -0,0 +1,50 @@
+#include <device_topology.h>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#pragma once
+
+// The arithmetic of the StorageEngine selection modes: the device of a block
+// id under RoundRobin, BatchedRoundRobin and Shift6, walking placement_cycle
+// (see DeviceTopology::placement_cycle).
+inline size_t round_robin_device(size_t block_id,
+                                 const std::vector<size_t>& placement_cycle) {
+    return placement_cycle[block_id % placement_cycle.size()];
+}
+
+inline size_t batched_round_robin_device(
+    size_t block_id, const std::vector<size_t>& placement_cycle,
+    size_t batch_size) {
+    return placement_cycle[(block_id / batch_size) % placement_cycle.size()];
+}
+
+inline size_t shift6_device(size_t block_id,
+                            const std::vector<size_t>& placement_cycle) {
+    const size_t cycle_size = placement_cycle.size();
+    return placement_cycle[(block_id + block_id / cycle_size) % cycle_size];
+}
+
+// Longest-processing-time greedy: blocks are taken from the hottest down
+// and each goes to the device whose expected load, relative to its weight,
+// would be the smallest after taking it. heat[block_id] is the access
+// probability (or any nonnegative access count) of the block; the result
+// maps every block id of heat to a device.
+std::vector<short> lpt_placement(const std::vector<double>& heat,
+                                 const DeviceTopology& topology);
+
+// expected load per device (sum of the heat of its blocks)
+std::vector<double> expected_device_load(const std::vector<double>& heat,
+                                         const std::vector<short>& placement,
+                                         size_t number_of_devices);
+
+// Moves that even out the expected load of an existing placement: the most
+// loaded device (relative to its weight) repeatedly gives the least loaded
+// one that has room the block whose move lowers the larger of their two
+// loads the most, until no move helps or max_migrations are planned. Blocks
+// past the end of heat are cold. Returns (block id, target device) pairs.
+std::vector<std::pair<size_t, short>> plan_migrations(
+    const std::vector<double>& heat, std::vector<short> placement,
+    const DeviceTopology& topology, std::vector<size_t> block_count_per_file,
+    size_t block_size, size_t max_migrations);
@@ -0,0 +1,74 @@
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#pragma once
+
+// A placement map file is this header followed by column_count uint16_t
+// column offsets and entry_count uint16_t device ids. With no columns the
+// i-th device id is the device of block id i; otherwise it is the device of
+// row group i, and create_column puts row group i of column c on
+//     (device of row group i + offset of column c) % number of devices
+// so that one entry places the whole row group.
+struct PlacementMapHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t number_of_devices;
+    uint32_t column_count;
+    uint64_t entry_count;
+};
+
+static const uint32_t kPlacementMapMagic = 0x50414d50;  // "PMAP"
+static const uint32_t kPlacementMapVersion = 1;
+
+// Read-only view of a placement map file mapped into memory: a lookup is an
+// array access, and the file is paged in as ingest walks through it instead
+// of being read up front.
+class PlacementMap {
+    void* map;
+    size_t map_size;
+    const PlacementMapHeader* header;
+    const uint16_t* column_offsets;
+    const uint16_t* devices = nullptr;  // set once open checked the sizes
+
+    PlacementMap(void* map, size_t map_size);
+
+  public:
+    // checks the header and that every device id is below number_of_devices
+    static absl::StatusOr<std::shared_ptr<const PlacementMap>> open(
+        const std::filesystem::path& path);
+    PlacementMap(const PlacementMap&) = delete;
+    PlacementMap& operator=(const PlacementMap&) = delete;
+    ~PlacementMap();
+
+    bool is_row_group_map() const { return header->column_count > 0; }
+    size_t size() const { return header->entry_count; }
+    size_t get_number_of_devices() const { return header->number_of_devices; }
+    size_t get_column_count() const { return header->column_count; }
+    // entry < size()
+    size_t device(size_t entry) const { return devices[entry]; }
+    // column < get_column_count()
+    size_t column_offset(size_t column) const { return column_offsets[column]; }
+};
+
+// every device id of placement must be below number_of_devices
+absl::Status save_placement_map(const std::filesystem::path& path,
+                                const std::vector<short>& placement,
+                                size_t number_of_devices);
+// a row group map, with a device per row group and an offset per column;
+// column_offsets must not be empty
+absl::Status save_row_group_placement_map(
+    const std::filesystem::path& path,
+    const std::vector<short>& row_group_placement,
+    const std::vector<short>& column_offsets, size_t number_of_devices);
+// device per block id of a map without columns
+absl::StatusOr<std::vector<short>> load_placement_map(
+    const std::filesystem::path& path);
+// the whitespace-separated device ids preliminary/QCQP.ipynb writes
+absl::StatusOr<std::vector<short>> load_text_placement_map(
+    const std::filesystem::path& path);
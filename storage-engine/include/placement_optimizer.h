@@ -0,0 +1,104 @@
+#include <device_topology.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#pragma once
+
+// blocks first and second are read together with probability weight
+struct CoAccess {
+    size_t first;
+    size_t second;
+    double weight;
+};
+
+struct PlacementOptimizerOptions {
+    size_t max_rounds = 32;       // passes over all blocks
+    size_t thread_number = 1;     // threads evaluating moves
+    size_t batch_size = 1 << 16;  // blocks evaluated per parallel step
+    // blocks of the least loaded device tried as the other half of a swap
+    size_t swap_candidates = 4;
+    uint64_t seed = 0;
+};
+
+// Native counterpart of the QCQP in preliminary/QCQP.ipynb. The expected
+// load of device d is
+//     L_d = (sum of heat[i] over the blocks i on d
+//            + sum of w over the co-accesses (i, j, w) with i and j on d)
+//           / weight of d
+// since two blocks read together from one device are served one after the
+// other instead of in parallel. This pair term is the quadratic part of the
+// formulation. optimize() minimizes max_d L_d, and among placements with the
+// same maximum the sum of weight_d * L_d^2 (the objective of the notebook),
+// so that the search can cross plateaus of the maximum.
+//
+// The continuous relaxation is minimized by splitting every block over the
+// devices by weight, and rounding that split block by block is the greedy
+// lpt_placement, which is where the search starts. It then moves a block to
+// another device (if it has room), or swaps it with one of swap_candidates
+// random blocks of the least loaded other device, as long as that lowers the
+// objective. Device loads are kept up to date, so a move costs
+// O(co-accesses of the block + devices) to evaluate. Moves for a batch of
+// blocks are evaluated on several threads against the state at the start of
+// the batch, and the improving ones are applied one by one after evaluating
+// them again against the current state.
+class PlacementOptimizer {
+    struct Move {
+        size_t target;      // number of devices if there is no move
+        size_t swap_block;  // block count if the block just moves
+        double max_load;
+        double square_sum_delta;
+    };
+
+    std::vector<double> heat;
+    std::vector<double> weight;    // per device
+    std::vector<size_t> capacity;  // blocks per device, -1 for unlimited
+    // co-accesses of block i are neighbors[neighbor_offsets[i],
+    // neighbor_offsets[i + 1]), both ways
+    std::vector<size_t> neighbor_offsets;
+    std::vector<size_t> neighbors;
+    std::vector<double> neighbor_weights;
+
+    std::vector<short> placement;
+    std::vector<double> load;  // per device, not divided by the weight
+    std::vector<std::vector<size_t>> device_blocks;
+    std::vector<size_t> block_position;  // in device_blocks
+
+    PlacementOptimizer(const std::vector<double>& heat,
+                       const DeviceTopology& topology, size_t block_size);
+
+    // device_load[d] = co-access weight of block_id with the blocks on d,
+    // leaving out the ones with excluded
+    void neighbor_load(size_t block_id, size_t excluded,
+                       std::vector<double>& device_load) const;
+    Move best_move(size_t block_id, uint64_t salt, size_t swap_candidates,
+                   std::vector<double>& block_load,
+                   std::vector<double>& other_load) const;
+    void apply(size_t block_id, const Move& move,
+               std::vector<double>& block_load,
+               std::vector<double>& other_load);
+    void set_device(size_t block_id, size_t device);
+
+  public:
+    // a device holds at most its capacity in the topology divided by
+    // block_size blocks; a placement it starts from may hold more, then
+    // blocks only leave it. Every co-access must name two different blocks
+    // of heat.
+    static absl::StatusOr<PlacementOptimizer> create(
+        const std::vector<double>& heat,
+        const std::vector<CoAccess>& co_accesses,
+        const DeviceTopology& topology, size_t block_size);
+
+    // starts the search from initial instead of lpt_placement
+    absl::Status set_placement(const std::vector<short>& initial);
+    // returns the number of moves and swaps applied
+    size_t optimize(const PlacementOptimizerOptions& options = {});
+
+    const std::vector<short>& get_placement() const;
+    std::vector<double> get_device_load() const;  // L_d
+    double get_max_load() const;
+};
@@ -0,0 +1,104 @@
+#include <device_topology.h>
+#include <storage_engine.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+#pragma once
+
+// Throughput model of a device under a deep queue of equal reads: a read of
+// `bytes` bytes takes the device for
+//     max(bytes / bandwidth, 1 / iops, latency / queue_depth)
+// seconds, whichever of bandwidth, IOPS and queue depth limits it.
+struct DeviceModel {
+    double bandwidth;    // bytes per second
+    double iops;         // reads per second
+    double latency;      // seconds per read with one read in flight
+    size_t queue_depth;  // reads kept in flight
+
+    double read_time(size_t bytes) const;
+};
+
+// a datacenter NVMe drive
+static const DeviceModel kDefaultDeviceModel = {3.2e9, 700e3, 80e-6, 32};
+
+// base for every device of the topology, with bandwidth and IOPS scaled by
+// the weight of the device
+std::vector<DeviceModel> device_models(const DeviceTopology& topology,
+                                       const DeviceModel& base =
+                                           kDefaultDeviceModel);
+
+// what SELECT SUM(B) WHERE A < bound reads at row group t
+enum class PositionOutcome : uint8_t {
+    Skip,    // the zone map rules out every row, nothing is read
+    ReadA,   // column A is read, no row passes
+    ReadB,   // the zone map passes every row, only column B is read
+    ReadAB,  // column A is read and some row passes
+};
+
+// outcome decided by the zone map of the column-A block alone: blocks it
+// can't decide count as ReadAB, so the estimate is an upper bound
+PositionOutcome zone_map_outcome(const BlockZoneMap& zone_map, int bound);
+
+// where column c, row group t goes, as StorageEngine would put it
+struct SimulatedPlacement {
+    // Contiguous: column c is the id range [c * n, (c + 1) * n) of a single
+    // create_blocks, as in the benchmarks before create_column; Spread and
+    // Colocate: columns made by create_column with that ColumnPlacement
+    enum ColumnLayout { Contiguous, Spread, Colocate };
+
+    StorageEngine::IdSelectionMode mode = StorageEngine::RoundRobin;
+    ColumnLayout layout = Contiguous;
+    size_t batch_size = 1;
+    // simulate takes an empty one as 0, 1, ..., number of devices - 1;
+    // select and device need it filled in
+    std::vector<size_t> placement_cycle;
+    // HeatAware and Explicit: device per id, the others go round robin
+    std::vector<short> block_placement;
+
+    // device of an id under mode
+    size_t select(size_t block_id) const;
+    size_t device(size_t column, size_t row_group, size_t row_group_count,
+                  size_t number_of_devices) const;
+};
+
+struct SimulationResult {
+    std::vector<uint64_t> reads;       // per device
+    std::vector<double> busy_time;     // seconds, per device
+    std::vector<double> utilization;   // busy time over the makespan
+    double makespan = 0;               // seconds, of the busiest device
+};
+
+// Estimates a two-column query (column A filtered, column B summed, as in
+// execute_query) under a placement without doing any I/O: the reads of every
+// device are counted on thread_number threads and priced with its
+// DeviceModel. Devices are assumed to work in parallel and to be the
+// bottleneck, so the makespan is the largest busy time.
+class PlacementSimulator {
+    std::vector<DeviceModel> devices;
+    size_t block_size;
+
+    // fills in the defaults of placement
+    SimulatedPlacement resolve(const SimulatedPlacement& placement) const;
+    SimulationResult price_reads(std::vector<uint64_t> reads) const;
+
+  public:
+    PlacementSimulator(const std::vector<DeviceModel>& devices,
+                       size_t block_size);
+
+    // outcomes[t] for every row group t
+    SimulationResult simulate(std::span<const PositionOutcome> outcomes,
+                              const SimulatedPlacement& placement,
+                              size_t thread_number = 1) const;
+    // outcome(t) for t in [0, row_group_count), for inputs that don't fit in
+    // memory; outcome is called from several threads at once
+    SimulationResult simulate(
+        size_t row_group_count,
+        const std::function<PositionOutcome(size_t)>& outcome,
+        const SimulatedPlacement& placement, size_t thread_number = 1) const;
+
+    size_t get_number_of_devices() const;
+};
@@ -0,0 +1,48 @@
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#pragma once
+
+// instruction set a predicate kernel runs on; the best one the CPU supports
+// is picked at runtime, an explicitly passed one must be supported
+enum class PredicateKernel { Scalar, Avx2, Avx512 };
+
+bool is_supported(PredicateKernel kernel);
+PredicateKernel best_predicate_kernel();
+
+// number of 64-bit words of a bitmap over value_count values
+constexpr size_t bitmap_word_count(size_t value_count) {
+    return (value_count + 63) / 64;
+}
+
+// Evaluates values[i] < bound over a whole block. Bit i % 64 of
+// bitmap[i / 64] is set iff value i passes, bits past the last value are
+// cleared; bitmap needs bitmap_word_count(values.size()) words. Returns the
+// number of passed values. Instantiated for int, float and int64_t (which
+// always runs the scalar kernel).
+template <typename T>
+size_t less_than_bitmap(std::span<const T> values, T bound,
+                        std::span<uint64_t> bitmap,
+                        PredicateKernel kernel = best_predicate_kernel());
+
+// whether any value is below bound, stops at the first vector that has one
+template <typename T>
+bool any_less_than(std::span<const T> values, T bound,
+                   PredicateKernel kernel = best_predicate_kernel());
+
+// Sum of the values whose bit is set in bitmap (laid out as produced by
+// less_than_bitmap), in a 64-bit accumulator so that large blocks of ints
+// can't overflow it.
+int64_t masked_sum(std::span<const int> values,
+                   std::span<const uint64_t> bitmap,
+                   PredicateKernel kernel = best_predicate_kernel());
+// The float and int64_t overloads are scalar only and ignore kernel: a
+// vector order of additions would make a float sum depend on the kernel,
+// and 64-bit values overflow the same way with any accumulator.
+double masked_sum(std::span<const float> values,
+                  std::span<const uint64_t> bitmap,
+                  PredicateKernel kernel = best_predicate_kernel());
+int64_t masked_sum(std::span<const int64_t> values,
+                   std::span<const uint64_t> bitmap,
+                   PredicateKernel kernel = best_predicate_kernel());
@@ -0,0 +1,65 @@
+#include <storage_engine.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#pragma once
+
+// default bound on the blocks moved by one rebalancing round
+static const size_t kDefaultMigrationsPerRound = 64;
+static const std::chrono::milliseconds kDefaultRebalanceInterval(1000);
+
+// Moves hot blocks from overloaded devices to underloaded ones while queries
+// keep running. Per-block heat is the one reported with set_block_heat, or
+// the engine's own read heat (StorageEngine::get_block_heat) if none was
+// reported. Every round plans moves with plan_migrations against the current placement and
+// carries them out with StorageEngine::migrate_block. Rounds run on a
+// background thread between start() and stop(), or on demand by rebalance().
+// Blocks must not be created while the rebalancer runs.
+class Rebalancer {
+    StorageEngine& storage_engine;
+    const size_t migrations_per_round;
+    const std::chrono::milliseconds interval;
+
+    std::mutex mutex;  // guards heat, stopped and status
+    std::condition_variable cv;
+    std::vector<double> heat;
+    bool stopped = true;
+    absl::Status status;
+    std::mutex round_mutex;  // one round at a time
+    std::atomic<size_t> migrated_count{0};
+    std::thread worker;
+
+    void worker_loop();
+
+  public:
+    explicit Rebalancer(
+        StorageEngine& storage_engine,
+        size_t migrations_per_round = kDefaultMigrationsPerRound,
+        std::chrono::milliseconds interval = kDefaultRebalanceInterval);
+    Rebalancer(const Rebalancer&) = delete;
+    Rebalancer& operator=(const Rebalancer&) = delete;
+    ~Rebalancer();  // finishes the running round, then joins the worker
+
+    void start();
+    void stop();
+
+    // latest observation, replaces the previous one
+    void set_block_heat(const std::vector<double>& heat);
+    void set_block_heat(const std::vector<size_t>& access_counts);
+
+    // runs one round now, returns the number of moved blocks
+    absl::StatusOr<size_t> rebalance();
+
+    size_t get_migrated_count() const;
+    // error of the last failed background round, OK if there was none
+    absl::Status get_status();
+};
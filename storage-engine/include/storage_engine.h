@@ -1,14 +1,28 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <shared_mutex>
+#include <span>
 #include <string>
 #include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "allocation_journal.h"
+#include "block_encoding.h"
+#include "buffer_pool.h"
+#include "device_topology.h"
+#include "heat_tracker.h"
+#include "io_stats.h"
+#include "placement_map.h"
+#include "value_type.h"
 
 #pragma once
 
@@ -37,6 +51,12 @@ static const std::vector<std::string> disk_pathes_one_disk = {
 static const std::vector<std::string> disk_pathes = disk_pathes_round_robin;
 
 static const size_t kNumberOfFiles = disk_pathes_round_robin.size();
+// number of BlockMetadata records read per pread when loading the table
+static const size_t kBlockMetadataChunkSize = 64 * 1024;
+// default number of reads kept in flight per device by get_blocks
+static const size_t kDefaultQueueDepth = 32;
+// unit of O_DIRECT transfers, encoded blocks take whole sectors
+static const size_t kSectorSize = 512;
 static const std::string storage_metas_path =
     "/home/xxeniash/SkewedDataBalancing/storage-engine/storage_metas/";
 
@@ -53,6 +73,25 @@ struct BlockMetadata {
     absl::Status sync(int fd, size_t block_id) const;
 };
 
+// min/max of a block read as ints, kept for every block by
+// StorageEngine::write, so that scans can decide a block without reading it;
+// write also records here how the block went to its device
+struct BlockZoneMap {
+    int min;
+    int max;
+    uint8_t valid;  // 0 until the block is written
+    BlockEncoding encoding;
+    uint16_t stored_sectors;  // sectors an encoded block takes
+
+    BlockZoneMap();
+    explicit BlockZoneMap(std::span<const int> values);
+
+    // false only if no value can be below bound
+    bool may_have_less_than(int bound) const;
+    // true only if every value is below bound
+    bool all_less_than(int bound) const;
+};
+
 class StorageMetadata {
     std::filesystem::path block_metadata_path;
     std::vector<std::string> filenames;
@@ -61,19 +100,36 @@ class StorageMetadata {
 
     static absl::StatusOr<StorageMetadata> read_existing_metadata(
         const std::filesystem::path& path);
+    static bool is_binary_metadata(const std::string& contents);
+    static absl::StatusOr<StorageMetadata> parse_binary_metadata(
+        const std::string& contents);
+    // whitespace-separated format used before the binary one
+    static absl::StatusOr<StorageMetadata> parse_text_metadata(
+        const std::string& contents);
+    std::string serialize_device_table() const;
     static absl::StatusOr<StorageMetadata> create_new_storage(
-        const std::filesystem::path& path);
+        const std::filesystem::path& path, const DeviceTopology& topology);
     static absl::Status create_files(const std::filesystem::path& path,
+                                     const DeviceTopology& topology,
                                      std::vector<std::string>& filenames);
+    // applies the allocations journaled since the last checkpoint
+    static absl::Status replay_journal(const std::filesystem::path& path,
+                                       StorageMetadata& metadata);
 
     StorageMetadata(const std::filesystem::path&, const std::vector<std::string>&,
                     const std::vector<size_t>, size_t);
 
   public:
     StorageMetadata();
-    static absl::StatusOr<StorageMetadata> create(const std::filesystem::path&);
+    // a new storage gets one file per device of the topology, an existing
+    // one must have as many devices as the topology
+    static absl::StatusOr<StorageMetadata> create(
+        const std::filesystem::path&,
+        const DeviceTopology& topology = DeviceTopology::default_topology());
 
     absl::Status sync(const std::filesystem::path& path) const;
+    // rewrites only the per-device block counts of a file written by sync
+    absl::Status sync_block_counts(int fd) const;
     size_t block_count() const;
     std::filesystem::path get_block_metadata() const;
     std::vector<std::string> get_filenames() const;
@@ -84,28 +140,92 @@ class StorageMetadata {
 };
 
 class BlockReader {
-    const size_t block_size;
+    size_t block_size;
     char* buffer;
+    std::shared_ptr<BufferPool> buffer_pool;  // nullptr: buffer is malloc'ed
     absl::Status status;
 
+    void release_buffer();
+    // reads the first read_size bytes of the block into the buffer it has
+    absl::Status read(int fd, long offset, size_t read_size);
+    // replaces the first stored_size bytes of the buffer, an encoded block,
+    // with the values it holds
+    absl::Status decode(size_t stored_size);
+
   public:
     BlockReader(int fd, size_t block_size, long offset);
-    BlockReader(const BlockReader&);
-    BlockReader& operator=(const BlockReader& other);
-    ~BlockReader();
+    BlockReader(std::shared_ptr<BufferPool> buffer_pool, int fd, long offset);
+    // reads only the first read_size bytes of the block
+    BlockReader(std::shared_ptr<BufferPool> buffer_pool, int fd, long offset,
+                size_t read_size);
+    // takes a buffer from the pool, but doesn't read
+    explicit BlockReader(std::shared_ptr<BufferPool> buffer_pool);
+    BlockReader(BlockReader&&) noexcept;
+    BlockReader& operator=(BlockReader&&) noexcept;
+    BlockReader(const BlockReader&) = delete;
+    BlockReader& operator=(const BlockReader&) = delete;
+    ~BlockReader();  // gives the buffer back to the pool
 
     bool is_ok() const;
     absl::Status get_status() const;
     int read_int(size_t num) const;
     int read_char(size_t num) const;
 
+    // zero-copy view of the whole block, valid while the reader is alive
+    template <typename T>
+    std::span<const T> view() const {
+        return std::span<const T>(reinterpret_cast<const T*>(buffer),
+                                  block_size / sizeof(T));
+    }
+
     std::string get_content() const;
+
+    friend StorageEngine;
 };
 
+class TraceRecorder;
+enum class TraceOperation : uint8_t;
+
 class StorageEngine {
   public:
     using BlockId = size_t;
-    enum IdSelectionMode { RoundRobin, OneDisk, BatchedRoundRobin, Shift6 };
+    // HeatAware places the blocks covered by set_block_heat with
+    // lpt_placement and falls back to RoundRobin for the others; Explicit
+    // places the blocks covered by set_block_placement or
+    // load_block_placement (e.g. a map of PlacementOptimizer) as it says and
+    // falls back to RoundRobin as well
+    enum IdSelectionMode {
+        RoundRobin,
+        OneDisk,
+        BatchedRoundRobin,
+        Shift6,
+        HeatAware,
+        Explicit
+    };
+    // how the block metadata table is brought in on open: read into
+    // block_metadata_cache in large chunks, or mapped and served from the
+    // mapping (blocks created after opening still go to the cache)
+    enum MetadataLoadMode { ChunkedRead, Mmap };
+    // how create_column places row group r of a column: Spread takes the
+    // device the mode selects for id r shifted by the index of the column,
+    // so that the blocks of one row group (read together by a query) are on
+    // different devices as long as there are no more columns than devices;
+    // Colocate takes the device selected for id r for every column, so that
+    // they share a device (or a batch of BatchedRoundRobin)
+    enum ColumnPlacement { Spread, Colocate };
+    // block first_block + r of a column holds its row group r; every block
+    // but the last holds block_size / value_size(value_type) rows
+    struct ColumnInfo {
+        std::string name;
+        size_t column_index;  // columns are numbered in creation order
+        BlockId first_block;
+        size_t block_count;
+        ColumnPlacement placement;
+        ValueType value_type;
+        size_t row_count;
+
+        std::vector<BlockId> get_block_ids() const;
+    };
 
   private:
     const IdSelectionMode mode;
@@ -114,18 +234,88 @@ class StorageEngine {
     size_t next_id;
     StorageMetadata storage_metadata;
     std::vector<BlockMetadata> block_metadata_cache;
+    MetadataLoadMode metadata_load_mode = ChunkedRead;
+    const BlockMetadata* block_metadata_map = nullptr;
+    size_t mapped_block_count = 0;
     std::vector<int> fd_cache;
     int block_metadata_fd;
+    int storage_metadata_fd = -1;
     size_t batch_size = -1;
-
-    BlockId round_robin_file_selection() const;
-    BlockId one_disk_selection() const;
-    BlockId batched_round_robin_selection() const;
-    BlockId shift6_selection() const;
+    std::shared_ptr<BufferPool> buffer_pool;
+    DeviceTopology topology = DeviceTopology::default_topology();
+    std::vector<size_t> placement_cycle = topology.placement_cycle();
+    std::vector<short> heat_placement;  // device per block id for HeatAware
+    std::vector<short> explicit_placement;  // device per block id for Explicit
+    // the map of load_block_placement, used instead of explicit_placement
+    std::shared_ptr<const PlacementMap> placement_map;
+    // block reads and writes hold it shared, migrate_block exclusively while
+    // it moves a block, so that no one reads a slot that is being overwritten
+    mutable std::shared_mutex block_table_mutex;
+    // accesses of get_block and get_blocks
+    std::unique_ptr<HeatTracker> heat_tracker;
+    std::chrono::milliseconds heat_half_life = kDefaultHeatHalfLife;
+    // latencies and bytes of the block reads and writes, per device
+    std::unique_ptr<IoStats> io_stats;
+    // every block read and write goes into it, nullptr unless tracing
+    std::shared_ptr<TraceRecorder> trace_recorder;
+    std::vector<BlockZoneMap> zone_maps;
+    int zone_map_fd = -1;
+    std::vector<ColumnInfo> columns;
+    bool block_compression = false;
+
+    // allocation journal, nullptr unless enabled; blocks below
+    // checkpointed_id are in the metadata files
+    std::unique_ptr<AllocationJournal> allocation_journal;
+    mutable size_t checkpointed_id = 0;
+    size_t journal_group_size = kDefaultJournalGroupSize;
+    size_t journal_checkpoint_interval = kDefaultJournalCheckpointInterval;
+    std::vector<size_t> reserved_blocks_per_file;
+
+    BlockId round_robin_file_selection(BlockId block_id) const;
+    BlockId one_disk_selection(BlockId block_id) const;
+    BlockId batched_round_robin_selection(BlockId block_id) const;
+    BlockId shift6_selection(BlockId block_id) const;
+    BlockId heat_aware_selection(BlockId block_id) const;
+    BlockId explicit_selection(BlockId block_id) const;
+    // device of block_id in a per-block placement_map, or else in
+    // explicit_placement; the number of files if neither has an entry
+    size_t explicit_block_device(BlockId block_id) const;
+    size_t select_file(BlockId block_id) const;
+    size_t select_column_file(const ColumnInfo& column, size_t row_group) const;
+    bool has_room(size_t file_id, size_t pending_blocks) const;
+    // the selected device, or the next one of the cycle if it reached its
+    // capacity
+    absl::StatusOr<size_t> place_block(
+        size_t selected_file_id,
+        const std::vector<size_t>* pending_per_file = nullptr) const;
+    // create_blocks with the device of every new block id picked by select
+    absl::StatusOr<BlockId> create_blocks(
+        size_t block_count, const std::function<size_t(BlockId)>& select);
 
     static absl::StatusOr<BlockMetadata> get_block_metadata_from_file(
         size_t block_id, int fd);
     BlockMetadata get_block_metadata(size_t block_id) const;
+    // updates both the metadata file and the in-memory table
+    absl::Status set_block_metadata(BlockId block_id,
+                                    const BlockMetadata& block_metadata);
+    // block that lives in the given slot, by a scan of the table
+    absl::StatusOr<BlockId> find_block(short file_id, long offset) const;
+    absl::Status copy_block(const BlockMetadata& from, const BlockMetadata& to);
+    // sizes the per-block tables (heat, zone maps) to next_id
+    void grow_block_tables();
+    // records an access that started at start and ends now, if tracing
+    void trace(TraceOperation operation, BlockId block_id, size_t file_id,
+               IoStats::Clock::time_point start) const;
+    absl::Status update_zone_map(BlockId block_id, const char* buffer,
+                                 BlockEncoding encoding = BlockEncoding::Plain,
+                                 size_t stored_size = 0);
+    // block_size, or the sectors of an encoded block
+    size_t get_stored_size(BlockId block_id) const;
+    absl::Status load_zone_maps();
+    // the column catalog, a "name first_block block_count placement
+    // value_type row_count" line per column
+    absl::Status load_columns();
+    absl::Status sync_columns() const;
 
     int get_block_file_fd(BlockId) const;
 
@@ -135,24 +325,125 @@ class StorageEngine {
     StorageEngine(IdSelectionMode, size_t, const std::filesystem::path&, size_t,
                   const StorageMetadata&, size_t);
     absl::Status open_caches();
+    absl::StatusOr<BlockId> create_journaled_block(size_t file_id);
+    absl::Status load_block_metadata();
+    void unmap_block_metadata();
 
   public:
     static absl::StatusOr<StorageEngine> create(
         const std::filesystem::path& path, StorageEngine::IdSelectionMode mode,
-        size_t block_size, size_t batch_size = -1);
+        size_t block_size, size_t batch_size = -1,
+        MetadataLoadMode metadata_load_mode = ChunkedRead,
+        const DeviceTopology& topology = DeviceTopology::default_topology());
     StorageEngine(const StorageEngine&);
     StorageEngine& operator=(const StorageEngine&) = delete;
     ~StorageEngine();
 
+    // replaces the pool readers take their buffers from; readers created
+    // before keep the old pool alive until they are destroyed
+    absl::Status configure_buffer_pool(size_t buffer_count,
+                                       bool use_hugepages = false);
+    std::shared_ptr<BufferPool> get_buffer_pool() const;
+
+    // from now on create_block only appends to an allocation journal
+    // (committed every group_size blocks), and the metadata files are
+    // brought up to date every checkpoint_interval blocks, by checkpoint()
+    // and on destruction; a crash loses at most the uncommitted group
+    absl::Status enable_allocation_journal(
+        size_t group_size = kDefaultJournalGroupSize,
+        size_t checkpoint_interval = kDefaultJournalCheckpointInterval);
+    absl::Status checkpoint() const;
+
+    // access probability (or count) per block id, for the HeatAware mode;
+    // only blocks created afterwards are placed by it
+    void set_block_heat(const std::vector<double>& heat);
+    void set_block_heat(const std::vector<size_t>& access_counts);
+    // device per block id for the Explicit mode; only blocks created
+    // afterwards are placed by it
+    absl::Status set_block_placement(const std::vector<short>& placement);
+    // maps a placement map file (see PlacementMap) for the Explicit mode in
+    // place of set_block_placement. A map per block id places create_block
+    // and create_column alike; a map per row group only places
+    // create_column, each column shifted by its offset in the map (columns
+    // past the offsets are shifted as their ColumnPlacement says).
+    absl::Status load_block_placement(const std::filesystem::path& path);
+
+    // decayed number of reads per block id, see HeatTracker
+    std::vector<double> get_block_heat() const;
+    void set_heat_half_life(std::chrono::milliseconds half_life);
+    // csv with a block_id,file_id,heat line per block
+    absl::Status export_block_heat(const std::filesystem::path& path) const;
+
+    IoStats& get_io_stats() const;
+    // from now on get_block, get_encoded_block, get_blocks, write and
+    // write_blocks record every block they access into trace_recorder;
+    // nullptr stops tracing. Must not be called concurrently with them.
+    void set_trace_recorder(std::shared_ptr<TraceRecorder> trace_recorder);
+
+    // blocks written afterwards are stored with encode_block when that saves
+    // at least a sector, and only their sectors are read back; readers still
+    // get plain blocks
+    void set_block_compression(bool enabled);
+
+    static std::filesystem::path get_zone_map_path(
+        const std::filesystem::path& path);
+    // a zone map that decides nothing for an invalid block_id, so that
+    // reading the block reports it
+    BlockZoneMap get_zone_map(BlockId block_id) const;
+
     absl::StatusOr<BlockId> create_block();
+    // reserves the ids [first, first + block_count) at once: extents are
+    // preallocated with fallocate and metadata is written once per batch;
+    // returns the first id
+    absl::StatusOr<BlockId> create_blocks(size_t block_count);
+    // creates the blocks of a column, one per row group, in a single
+    // create_blocks batch; placement decides where each row group goes
+    // relative to the same row group of the other columns (see
+    // ColumnPlacement), the name must be unique and have no whitespace;
+    // row_count = -1 stands for full blocks
+    absl::StatusOr<std::vector<BlockId>> create_column(
+        const std::string& name, size_t block_count,
+        ColumnPlacement placement = Spread,
+        ValueType value_type = ValueType::Int32, size_t row_count = -1);
+    absl::StatusOr<ColumnInfo> get_column(const std::string& name) const;
+    const std::vector<ColumnInfo>& get_columns() const;
+    static std::filesystem::path get_columns_path(
+        const std::filesystem::path& path);
 
     absl::StatusOr<BlockReader> get_block(BlockId block_id) const;
+    // the block as stored, so that a scan can evaluate its predicate on the
+    // encoded form (see encoded_less_than_bitmap); plain blocks are read as
+    // by get_block
+    absl::StatusOr<BlockReader> get_encoded_block(BlockId block_id) const;
+    // reads all the blocks at once through io_uring, keeping up to
+    // queue_depth reads in flight on every device; readers are returned in
+    // the order of block_ids
+    absl::StatusOr<std::vector<BlockReader>> get_blocks(
+        std::span<const BlockId> block_ids,
+        size_t queue_depth = kDefaultQueueDepth) const;
     absl::Status counting_get_block(BlockId block_id, std::vector<size_t>&) const; // this is only needed profiling
 
+    // Moves the block to a new slot at the end of the target device. The
+    // last block of the source device then takes the freed slot, so that the
+    // device files stay dense and the block counts are unchanged. Safe to
+    // run while other threads read and write blocks, but not while they
+    // create blocks. Not crash-atomic: a crash in the middle may leave the
+    // new slot outside of the target's block count.
+    absl::Status migrate_block(BlockId block_id, size_t target_file_id);
+
     absl::Status write(char* buffer, BlockId block_id);
+    // writes buffers[i] into block_ids[i] without copying: buffers must be
+    // 512-byte aligned and stay untouched until the call returns
+    absl::Status write_blocks(std::span<const BlockId> block_ids,
+                              std::span<char* const> buffers);
 
     StorageMetadata get_metadata() const;
     size_t get_block_size() const;
+    size_t get_block_count() const;
+    size_t get_number_of_files() const;
+    const DeviceTopology& get_topology() const;
+    // device (index into the metadata filenames) that holds the block
+    short get_block_file_id(BlockId block_id) const;
 
     friend std::ostream& operator<<(std::ostream&, const StorageEngine&);
 };
@@ -0,0 +1,105 @@
+#include <storage_engine.h>
+#include <value_type.h>
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#pragma once
+
+// number of blocks Column::write hands to StorageEngine::write_blocks at once
+static const size_t kColumnWriteBatch = 64;
+
+// the rows of one block of a column, valid while the block is alive
+template <typename T>
+class ColumnBlock {
+    BlockReader reader;
+    size_t row_count;
+
+  public:
+    ColumnBlock(BlockReader reader, size_t row_count);
+
+    std::span<const T> values() const;
+    size_t get_row_count() const;
+};
+
+// Typed view of a column created by StorageEngine::create_column: row r is
+// value r % rows_per_block of block r / rows_per_block, and the tail of the
+// last block past the row count is padding. Instantiated for int32_t, float
+// and int64_t; opening a column as another type than the one it was created
+// with fails.
+template <typename T>
+class Column {
+    StorageEngine* storage_engine;
+    StorageEngine::ColumnInfo column_info;
+    size_t rows_per_block;
+
+    Column(StorageEngine& storage_engine,
+           const StorageEngine::ColumnInfo& column_info);
+
+  public:
+    static absl::StatusOr<Column<T>> open(StorageEngine& storage_engine,
+                                          const std::string& name);
+
+    const std::string& get_name() const;
+    size_t get_row_count() const;
+    size_t get_block_count() const;
+    size_t get_rows_per_block() const;
+    // rows_per_block for every block but the last
+    size_t get_block_row_count(size_t block) const;
+    StorageEngine::BlockId get_block_id(size_t block) const;
+    std::vector<StorageEngine::BlockId> get_block_ids() const;
+    StorageEngine& get_storage_engine() const;
+
+    absl::StatusOr<ColumnBlock<T>> read_block(size_t block) const;
+    // values must hold get_block_row_count(block) rows
+    absl::Status write_block(size_t block, std::span<const T> values);
+    // writes all the rows, kColumnWriteBatch blocks per write_blocks
+    absl::Status write(std::span<const T> values);
+};
+
+// Columns with the same row count, stored as the columns "<table>.<column>"
+// of the engine, so that the engine's column catalog is the table catalog
+// as well. The columns are created one after another, so placement spreads
+// or colocates their row groups.
+class Table {
+  public:
+    using Schema = std::vector<std::pair<std::string, ValueType>>;
+
+  private:
+    StorageEngine* storage_engine;
+    std::string name;
+    size_t row_count;
+    Schema schema;
+
+    Table(StorageEngine& storage_engine, const std::string& name,
+          size_t row_count, const Schema& schema);
+
+  public:
+    // table and column names must have no '.' and no whitespace
+    static absl::StatusOr<Table> create(
+        StorageEngine& storage_engine, const std::string& name,
+        size_t row_count, const Schema& schema,
+        StorageEngine::ColumnPlacement placement =
+            StorageEngine::ColumnPlacement::Spread);
+    static absl::StatusOr<Table> open(StorageEngine& storage_engine,
+                                      const std::string& name);
+
+    static std::string get_column_name(const std::string& table_name,
+                                       const std::string& column_name);
+
+    const std::string& get_name() const;
+    size_t get_row_count() const;
+    const Schema& get_schema() const;
+
+    template <typename T>
+    absl::StatusOr<Column<T>> get_column(const std::string& column_name) const {
+        return Column<T>::open(*storage_engine,
+                               get_column_name(name, column_name));
+    }
+};
@@ -0,0 +1,34 @@
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#pragma once
+
+// type of the values of a column
+enum class ValueType { Int32, Float, Int64 };
+
+constexpr size_t value_size(ValueType value_type) {
+    switch (value_type) {
+    case ValueType::Int32:
+        return sizeof(int32_t);
+    case ValueType::Float:
+        return sizeof(float);
+    case ValueType::Int64:
+        return sizeof(int64_t);
+    }
+    return 0;
+}
+
+template <typename T>
+constexpr ValueType value_type_of() {
+    static_assert(std::is_same_v<T, int32_t> || std::is_same_v<T, float> ||
+                      std::is_same_v<T, int64_t>,
+                  "columns hold int32_t, float or int64_t values");
+    if constexpr (std::is_same_v<T, float>) return ValueType::Float;
+    if constexpr (std::is_same_v<T, int64_t>) return ValueType::Int64;
+    return ValueType::Int32;
+}
+
+// accumulator of a sum over values of type T
+template <typename T>
+using SumType = std::conditional_t<std::is_floating_point_v<T>, double, int64_t>;
@@ -1,11 +1,15 @@
 #include <data_generator_impl.h>
 #include <execute_query.h>
+#include <placement_simulator.h>
 #include <storage_engine.h>
+#include <table.h>
 
 #include <cassert>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <ios>
 #include <string>
 #include <thread>
@@ -16,8 +20,11 @@
 constexpr size_t data_size = size_t(2) * 1024 * 1024 * 1024;
 
 static const std::string kStoragePath = "benchmark_store_4";
+static const std::string kTableName = "t";
 
 #define FLAGS_num_iterations 1
+#define FLAGS_prefetch_distance kDefaultPrefetchDistance
+#define FLAGS_column_placement StorageEngine::ColumnPlacement::Spread
 
 std::string mode_to_string(const StorageEngine::IdSelectionMode mode) {
     switch (mode) {
@@ -29,6 +36,10 @@ std::string mode_to_string(const StorageEngine::IdSelectionMode mode) {
         return "BatchedRoundRobin";
     case StorageEngine::IdSelectionMode::Shift6:
         return "Shift6";
+    case StorageEngine::IdSelectionMode::HeatAware:
+        return "HeatAware";
+    case StorageEngine::IdSelectionMode::Explicit:
+        return "Explicit";
     default:
         return "UnrecognizedMode";
     }
@@ -49,9 +60,12 @@ void clean_storage(const std::filesystem::path& path) {
     std::filesystem::remove(block_metadata);
 }
 
+// int columns "a" and "b" of table kTableName, data_size / block_size / 2
+// blocks each
 void fill_storage(StorageEngine& storage_engine, size_t block_size, int n,
                   float step) {
-    const size_t block_count = data_size / block_size;
+    const size_t col_size = data_size / block_size / 2;
+    const size_t block_count = 2 * col_size;
 
     std::vector<float> means;
     std::vector<float> variances;
@@ -67,13 +81,25 @@ void fill_storage(StorageEngine& storage_engine, size_t block_size, int n,
     MixOfNormalDistributions gen(means, variances);
     int** data = gen.generate_blocks<int>(block_count, block_size);
 
+    auto table_res = Table::create(
+        storage_engine, kTableName, col_size * (block_size / sizeof(int)),
+        {{"a", ValueType::Int32}, {"b", ValueType::Int32}},
+        FLAGS_column_placement);
+    assert(table_res.ok() && "Table::create failed");
+    std::vector<StorageEngine::BlockId> block_ids;
+    for (const std::string name : {"a", "b"}) {
+        const auto column_block_ids =
+            table_res->get_column<int>(name)->get_block_ids();
+        block_ids.insert(block_ids.end(), column_block_ids.begin(),
+                         column_block_ids.end());
+    }
+    std::vector<char*> buffers;
+    buffers.reserve(block_count);
     for (size_t i = 0; i < block_count; ++i) {
-        auto create_res = storage_engine.create_block();
-        assert(create_res.ok() && "StorageEngine::create_block failed");
-        StorageEngine::BlockId block_id = create_res.value();
-        auto write_res =
-            storage_engine.write(reinterpret_cast<char*>(data[i]), block_id);
+        buffers.emplace_back(reinterpret_cast<char*>(data[i]));
     }
+    auto write_res = storage_engine.write_blocks(block_ids, buffers);
+    assert(write_res.ok() && "StorageEngine::write_blocks failed");
 
     for (size_t i = 0; i < block_count; ++i) {
         delete[] data[i];
@@ -81,28 +107,44 @@ void fill_storage(StorageEngine& storage_engine, size_t block_size, int n,
     delete[] data;
 }
 
-void execute_query_benchmark(StorageEngine& storage_engine, int& sum,
-                             size_t block_size, int upper_bound,
-                             std::vector<size_t>& cnt) {
-    const size_t block_count = data_size / block_size;
-    const size_t col_size = block_count / 2;  // may be it will be changed
-
-    std::vector<StorageEngine::BlockId> col_a;
-    std::vector<StorageEngine::BlockId> col_b;
-    col_a.reserve(col_size);
-    col_b.reserve(col_size);
-    for (size_t i = 0; i < col_size; ++i) {
-        col_a.emplace_back(i);
-        col_b.emplace_back(i + col_size);
-    }
-
-    auto res =
-        counting_execute_query(storage_engine, col_a, col_b, upper_bound, cnt);
+void execute_query_benchmark(StorageEngine& storage_engine, int64_t& sum,
+                             int upper_bound, std::vector<size_t>& cnt,
+                             size_t thread_number) {
+    auto table_res = Table::open(storage_engine, kTableName);
+    assert(table_res.ok());
+    auto col_a_res = table_res->get_column<int>("a");
+    auto col_b_res = table_res->get_column<int>("b");
+    assert(col_a_res.ok() && col_b_res.ok());
+    const std::vector<StorageEngine::BlockId> col_a = col_a_res->get_block_ids();
+    const std::vector<StorageEngine::BlockId> col_b = col_b_res->get_block_ids();
+
+    auto res = parallel_counting_execute_query(storage_engine, col_a, col_b,
+                                               upper_bound, cnt, thread_number);
     assert(res.ok());
     for (auto val : cnt) {
         std::cout << val << " ";
     }
     std::cout << std::endl;
+
+    long long time = 0;
+    auto sum_res = execute_query(storage_engine, time, col_a, col_b,
+                                 upper_bound, thread_number);
+    assert(sum_res.ok());
+    sum = *sum_res;
+    std::cout << "execute_query sum: " << sum << ", time: " << time << " ms"
+              << std::endl;
+
+    IoScheduler io_scheduler(storage_engine);
+    const auto start = std::chrono::steady_clock::now();
+    auto pipelined_res =
+        pipelined_execute_query(storage_engine, io_scheduler, col_a, col_b,
+                                upper_bound, FLAGS_prefetch_distance);
+    assert(pipelined_res.ok() && *pipelined_res == sum);
+    std::cout << "pipelined_execute_query time: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()
+              << " ms" << std::endl;
 }
 
 void basic_benchmark(const std::string& log_file,
@@ -112,6 +154,10 @@ void basic_benchmark(const std::string& log_file,
 
     std::ofstream out;
     out.open(log_file, std::ios_base::app | std::ios_base::out);
+    // per-device latencies of every run go next to the log
+    std::filesystem::path io_stats_log_file = log_file;
+    io_stats_log_file.replace_extension("");
+    io_stats_log_file += "_io_stats.csv";
 
     std::cout << data_size << std::endl;
 
@@ -139,15 +185,19 @@ void basic_benchmark(const std::string& log_file,
                     // make a pause between consecutive runs
                     std::this_thread::sleep_for(2000ms);
 
-                    int execute_query_sum = 0;
+                    int64_t execute_query_sum = 0;
 
                     std::cout << "data size: " << data_size
                               << ", block size: " << block_size
                               << ", upper bound: " << upper_bound
                               << ", mode: " << mode_to_string(mode) << std::endl;
                     std::vector<size_t> cnt(kNumberOfFiles);
-                    execute_query_benchmark(storage_engine, execute_query_sum, block_size,
-                                            upper_bound, cnt);
+                    execute_query_benchmark(storage_engine, execute_query_sum,
+                                            upper_bound, cnt, thread_number);
+                    auto dump_res =
+                        storage_engine.get_io_stats().dump_csv(io_stats_log_file);
+                    assert(dump_res.ok() && "IoStats::dump_csv failed");
+                    storage_engine.get_io_stats().reset();
 
                     out << data_size << "," << block_size << "," << upper_bound << ","
                         << mode_to_string(mode);
@@ -162,6 +212,103 @@ void basic_benchmark(const std::string& log_file,
     out.close();
 }
 
+// block allocation throughput: create_block with per-block metadata
+// rewrites, create_block through the allocation journal, and create_blocks
+void create_block_benchmark(const std::string& log_file, size_t block_size,
+                            size_t block_count) {
+    std::ofstream out;
+    out.open(log_file, std::ios_base::app | std::ios_base::out);
+
+    for (const std::string variant : {"create_block", "journaled_create_block",
+                                      "create_blocks"}) {
+        std::filesystem::path path = kStoragePath;
+        clean_storage(path);
+
+        auto create_res = StorageEngine::create(
+            path, StorageEngine::IdSelectionMode::RoundRobin, block_size);
+        assert(create_res.ok() && "StorageEngine::create failed");
+        StorageEngine storage_engine = create_res.value();
+
+        auto start = std::chrono::steady_clock::now();
+        if (variant == "create_blocks") {
+            auto res = storage_engine.create_blocks(block_count);
+            assert(res.ok());
+        } else {
+            if (variant == "journaled_create_block") {
+                auto res = storage_engine.enable_allocation_journal();
+                assert(res.ok());
+            }
+            for (size_t i = 0; i < block_count; ++i) {
+                auto res = storage_engine.create_block();
+                assert(res.ok());
+            }
+            auto res = storage_engine.checkpoint();
+            assert(res.ok());
+        }
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+
+        std::cout << variant << ": " << block_count << " blocks in " << time
+                  << " us" << std::endl;
+        out << block_size << "," << block_count << "," << variant << "," << time
+            << std::endl;
+    }
+    out.close();
+}
+
+// makespan of every mode and column layout for row_group_count row groups,
+// estimated by PlacementSimulator; the query passes in 1% of the row groups
+// except for a hot tenth of them, where it passes in 50%
+void placement_simulation_benchmark(const std::string& log_file,
+                                    size_t row_group_count,
+                                    size_t block_size) {
+    std::ofstream out;
+    out.open(log_file, std::ios_base::app | std::ios_base::out);
+    const DeviceTopology topology = DeviceTopology::default_topology();
+    PlacementSimulator simulator(device_models(topology), block_size);
+    auto outcome = [row_group_count](size_t t) {
+        const uint64_t hash = (t * 0x9E3779B97F4A7C15ull) >> 40;
+        const bool hot = t < row_group_count / 10;
+        return (hash % 100 < (hot ? 50u : 1u)) ? PositionOutcome::ReadAB
+                                               : PositionOutcome::ReadA;
+    };
+
+    for (auto mode : {StorageEngine::IdSelectionMode::RoundRobin,
+                      StorageEngine::IdSelectionMode::BatchedRoundRobin,
+                      StorageEngine::IdSelectionMode::Shift6,
+                      StorageEngine::IdSelectionMode::OneDisk}) {
+        for (auto layout : {SimulatedPlacement::Contiguous,
+                            SimulatedPlacement::Spread,
+                            SimulatedPlacement::Colocate}) {
+            SimulatedPlacement placement;
+            placement.mode = mode;
+            placement.layout = layout;
+            placement.batch_size = 64;
+            placement.placement_cycle = topology.placement_cycle();
+            const auto start = std::chrono::steady_clock::now();
+            const auto result = simulator.simulate(
+                row_group_count, outcome, placement,
+                std::thread::hardware_concurrency());
+            const auto time =
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+            std::cout << mode_to_string(mode) << ", layout " << layout
+                      << ": makespan " << result.makespan << " s, simulated in "
+                      << time << " ms" << std::endl;
+            out << row_group_count << "," << block_size << ","
+                << mode_to_string(mode) << "," << layout << ","
+                << result.makespan;
+            for (auto utilization : result.utilization) {
+                out << "," << utilization;
+            }
+            out << std::endl;
+        }
+    }
+    out.close();
+}
+
 void basic_benchmark_set(const std::string& log_file) {
     using namespace std::chrono_literals;
     basic_benchmark(log_file, StorageEngine::IdSelectionMode::RoundRobin);
@@ -172,6 +319,14 @@ void basic_benchmark_set(const std::string& log_file) {
 }
 
 int main(int argc, char** argv) {
+    placement_simulation_benchmark(
+        "/scratch/shastako/proteus/apps/standalones/data-balancing/logs/"
+        "log_placement_simulation.csv",
+        size_t(1) << 30, 1 << 16);
+    create_block_benchmark(
+        "/scratch/shastako/proteus/apps/standalones/data-balancing/logs/"
+        "log_create_block.csv",
+        1 << 12, data_size / (1 << 12));
     basic_benchmark_set(
         "/scratch/shastako/proteus/apps/standalones/data-balancing/logs/"
         "log_retrieved_part.csv");
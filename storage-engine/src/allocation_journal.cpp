@@ -0,0 +1,155 @@
+#include <allocation_journal.h>
+#include <fcntl.h>
+#include <storage_engine.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace {
+
+uint32_t record_checksum(uint64_t block_id, uint32_t file_id, int64_t offset) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint64_t value : {block_id, uint64_t(file_id), uint64_t(offset)}) {
+        for (int i = 0; i < 8; ++i) {
+            hash ^= (value >> (8 * i)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    }
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+}  // namespace
+
+JournalRecord::JournalRecord() : block_id(0), offset(0), file_id(0), checksum(0) {}
+
+JournalRecord::JournalRecord(uint64_t block_id, uint32_t file_id,
+                             int64_t offset)
+    : block_id(block_id),
+      offset(offset),
+      file_id(file_id),
+      checksum(record_checksum(block_id, file_id, offset)) {}
+
+bool JournalRecord::is_valid() const {
+    return checksum == record_checksum(block_id, file_id, offset);
+}
+
+AllocationJournal::AllocationJournal(const std::filesystem::path& journal_path,
+                                     int fd, size_t group_size,
+                                     size_t file_size)
+    : journal_path(journal_path),
+      fd(fd),
+      group_size(group_size),
+      file_size(file_size) {
+    pending.reserve(group_size);
+}
+
+std::filesystem::path AllocationJournal::get_journal_path(
+    const std::filesystem::path& path) {
+    return storage_metas_path + path.generic_string() + "_journal";
+}
+
+absl::StatusOr<std::unique_ptr<AllocationJournal>> AllocationJournal::open(
+    const std::filesystem::path& path, size_t group_size) {
+    if (group_size == 0) group_size = 1;
+    const std::filesystem::path journal_path = get_journal_path(path);
+    int fd = ::open(journal_path.c_str(), O_WRONLY | O_CREAT, 0666);
+    if (fd < 0) {
+        return absl::UnavailableError(
+            "AllocationJournal::open error: opening journal file failed");
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return absl::UnavailableError(
+            "AllocationJournal::open error: fstat failed");
+    }
+    return std::unique_ptr<AllocationJournal>(
+        new AllocationJournal(journal_path, fd, group_size, file_stat.st_size));
+}
+
+absl::StatusOr<std::vector<JournalRecord>> AllocationJournal::read_records(
+    const std::filesystem::path& path) {
+    std::vector<JournalRecord> records;
+    const std::filesystem::path journal_path = get_journal_path(path);
+    if (!std::filesystem::exists(journal_path)) return records;
+
+    int fd = ::open(journal_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return absl::UnavailableError(
+            "AllocationJournal::read_records error: opening journal file "
+            "failed");
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return absl::UnavailableError(
+            "AllocationJournal::read_records error: fstat failed");
+    }
+    // a torn tail shorter than a record is ignored
+    records.resize(file_stat.st_size / sizeof(JournalRecord));
+    const size_t bytes = records.size() * sizeof(JournalRecord);
+    const size_t bytes_read = pread(fd, records.data(), bytes, 0);
+    close(fd);
+    if (bytes_read != bytes) {
+        return absl::UnavailableError(
+            "AllocationJournal::read_records error: read failed");
+    }
+
+    for (size_t i = 0; i < records.size(); ++i) {
+        if (!records[i].is_valid()) {
+            records.resize(i);
+            break;
+        }
+    }
+    return records;
+}
+
+AllocationJournal::~AllocationJournal() {
+    commit().IgnoreError();
+    close(fd);
+}
+
+absl::Status AllocationJournal::append(const JournalRecord& record) {
+    pending.emplace_back(record);
+    if (pending.size() >= group_size) return commit();
+    return absl::OkStatus();
+}
+
+absl::Status AllocationJournal::commit() {
+    if (pending.empty()) return absl::OkStatus();
+    const size_t bytes = pending.size() * sizeof(JournalRecord);
+    const size_t bytes_written = pwrite(fd, pending.data(), bytes, file_size);
+    if (bytes_written != bytes) {
+        return absl::UnknownError(
+            "AllocationJournal::commit error: number of written bytes is less "
+            "than expected");
+    }
+    if (fdatasync(fd) != 0) {
+        return absl::UnknownError("AllocationJournal::commit error: fdatasync failed");
+    }
+    file_size += bytes;
+    pending.clear();
+    return absl::OkStatus();
+}
+
+absl::Status AllocationJournal::truncate() {
+    if (ftruncate(fd, 0) != 0 || fdatasync(fd) != 0) {
+        return absl::UnknownError(
+            "AllocationJournal::truncate error: truncating journal failed");
+    }
+    file_size = 0;
+    pending.clear();
+    return absl::OkStatus();
+}
+
+size_t AllocationJournal::get_pending_count() const { return pending.size(); }
@@ -0,0 +1,337 @@
+#include <block_encoding.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BLOCK_ENCODING_X86 1
+#endif
+
+namespace {
+
+// the kernels gather 32 bits at the byte of a code, so they take codes of
+// up to 32 - 7 bits
+constexpr size_t kMaxGatherBitWidth = 25;
+
+size_t bit_width_of(uint64_t max_code) {
+    return max_code == 0 ? 0 : std::bit_width(max_code);
+}
+
+size_t packed_size(size_t value_count, size_t bit_width) {
+    return (value_count * bit_width + 7) / 8 + kEncodedBlockSlack;
+}
+
+uint32_t read_code(const char* packed, size_t bit_width, size_t i) {
+    const size_t bit = i * bit_width;
+    uint64_t word;
+    memcpy(&word, packed + bit / 8, sizeof(word));
+    return static_cast<uint32_t>((word >> (bit % 8)) &
+                                 ((uint64_t(1) << bit_width) - 1));
+}
+
+// codes must fit into bit_width bits
+template <typename Code>
+void pack_codes(size_t value_count, size_t bit_width, const Code& code,
+                char* packed) {
+    memset(packed, 0, packed_size(value_count, bit_width));
+    for (size_t i = 0; i < value_count; ++i) {
+        const size_t bit = i * bit_width;
+        uint64_t word;
+        memcpy(&word, packed + bit / 8, sizeof(word));
+        word |= uint64_t(code(i)) << (bit % 8);
+        memcpy(packed + bit / 8, &word, sizeof(word));
+    }
+}
+
+size_t scalar_packed_less_than(const char* packed, size_t bit_width,
+                               size_t value_count, uint32_t threshold,
+                               std::span<uint64_t> bitmap, size_t first) {
+    size_t passed = 0;
+    for (size_t i = first; i < value_count; ++i) {
+        if (i % 64 == 0) bitmap[i / 64] = 0;
+        if (read_code(packed, bit_width, i) < threshold) {
+            bitmap[i / 64] |= uint64_t(1) << (i % 64);
+            ++passed;
+        }
+    }
+    return passed;
+}
+
+#ifdef BLOCK_ENCODING_X86
+
+__attribute__((target("avx2"))) size_t avx2_packed_less_than(
+    const char* packed, size_t bit_width, size_t value_count,
+    uint32_t threshold, std::span<uint64_t> bitmap) {
+    const __m256i lane_bits =
+        _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                           _mm256_set1_epi32(bit_width));
+    const __m256i mask = _mm256_set1_epi32((uint32_t(1) << bit_width) - 1);
+    const __m256i threshold_vector = _mm256_set1_epi32(threshold);
+    const size_t full_words = value_count / 64;
+    size_t passed = 0;
+    for (size_t w = 0; w < full_words; ++w) {
+        uint64_t word = 0;
+        for (size_t j = 0; j < 8; ++j) {
+            const size_t bit = (w * 64 + 8 * j) * bit_width;
+            const __m256i bits =
+                _mm256_add_epi32(lane_bits, _mm256_set1_epi32(bit % 8));
+            const __m256i gathered = _mm256_i32gather_epi32(
+                reinterpret_cast<const int*>(packed + bit / 8),
+                _mm256_srli_epi32(bits, 3), 1);
+            const __m256i codes = _mm256_and_si256(
+                _mm256_srlv_epi32(gathered,
+                                  _mm256_and_si256(bits, _mm256_set1_epi32(7))),
+                mask);
+            // codes and threshold are below 2^25, a signed compare is enough
+            const uint32_t lanes = _mm256_movemask_ps(_mm256_castsi256_ps(
+                _mm256_cmpgt_epi32(threshold_vector, codes)));
+            word |= uint64_t(lanes) << (8 * j);
+        }
+        bitmap[w] = word;
+        passed += std::popcount(word);
+    }
+    return passed + scalar_packed_less_than(packed, bit_width, value_count,
+                                            threshold, bitmap, full_words * 64);
+}
+
+__attribute__((target("avx512f"))) size_t avx512_packed_less_than(
+    const char* packed, size_t bit_width, size_t value_count,
+    uint32_t threshold, std::span<uint64_t> bitmap) {
+    const __m512i lane_bits = _mm512_mullo_epi32(
+        _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+        _mm512_set1_epi32(bit_width));
+    const __m512i mask = _mm512_set1_epi32((uint32_t(1) << bit_width) - 1);
+    const __m512i threshold_vector = _mm512_set1_epi32(threshold);
+    const size_t full_words = value_count / 64;
+    size_t passed = 0;
+    for (size_t w = 0; w < full_words; ++w) {
+        uint64_t word = 0;
+        for (size_t j = 0; j < 4; ++j) {
+            const size_t bit = (w * 64 + 16 * j) * bit_width;
+            const __m512i bits =
+                _mm512_add_epi32(lane_bits, _mm512_set1_epi32(bit % 8));
+            const __m512i gathered = _mm512_i32gather_epi32(
+                _mm512_srli_epi32(bits, 3), packed + bit / 8, 1);
+            const __m512i codes = _mm512_and_si512(
+                _mm512_srlv_epi32(gathered,
+                                  _mm512_and_si512(bits, _mm512_set1_epi32(7))),
+                mask);
+            word |= uint64_t(_mm512_cmplt_epu32_mask(codes, threshold_vector))
+                    << (16 * j);
+        }
+        bitmap[w] = word;
+        passed += std::popcount(word);
+    }
+    return passed + scalar_packed_less_than(packed, bit_width, value_count,
+                                            threshold, bitmap, full_words * 64);
+}
+
+#endif  // BLOCK_ENCODING_X86
+
+size_t packed_less_than(const char* packed, size_t bit_width,
+                        size_t value_count, uint32_t threshold,
+                        std::span<uint64_t> bitmap, PredicateKernel kernel) {
+    if (bit_width <= kMaxGatherBitWidth) {
+        switch (kernel) {
+#ifdef BLOCK_ENCODING_X86
+        case PredicateKernel::Avx512:
+            return avx512_packed_less_than(packed, bit_width, value_count,
+                                           threshold, bitmap);
+        case PredicateKernel::Avx2:
+            return avx2_packed_less_than(packed, bit_width, value_count,
+                                         threshold, bitmap);
+#endif
+        default:
+            break;
+        }
+    }
+    return scalar_packed_less_than(packed, bit_width, value_count, threshold,
+                                   bitmap, 0);
+}
+
+// every value passes: bits past the last one stay cleared
+size_t fill_bitmap(size_t value_count, std::span<uint64_t> bitmap) {
+    std::fill(bitmap.begin(), bitmap.begin() + bitmap_word_count(value_count),
+              ~uint64_t(0));
+    if (value_count % 64 != 0) {
+        bitmap[value_count / 64] = (uint64_t(1) << (value_count % 64)) - 1;
+    }
+    return value_count;
+}
+
+// caller names the function in the error message
+absl::Status check_header(std::span<const char> encoded,
+                          EncodedBlockHeader& header, const char* caller) {
+    if (encoded.size() < sizeof(header)) {
+        return absl::DataLossError(std::string(caller) +
+                                   " error: block is shorter than its header");
+    }
+    memcpy(&header, encoded.data(), sizeof(header));
+    size_t size = sizeof(header) + packed_size(header.value_count,
+                                               header.bit_width);
+    switch (header.encoding) {
+    case BlockEncoding::FrameOfReference:
+        break;
+    case BlockEncoding::Dictionary:
+        size += header.dictionary_size * sizeof(int);
+        break;
+    default:
+        return absl::DataLossError(std::string(caller) +
+                                   " error: unknown encoding");
+    }
+    if (header.bit_width > 32 || size > encoded.size()) {
+        return absl::DataLossError(std::string(caller) +
+                                   " error: block is truncated");
+    }
+    return absl::OkStatus();
+}
+
+}  // namespace
+
+size_t encode_block(std::span<const int> values, std::span<char> encoded) {
+    if (values.empty()) return 0;
+    EncodedBlockHeader header{};
+    header.value_count = values.size();
+
+    const auto [min, max] = std::minmax_element(values.begin(), values.end());
+    const size_t for_bit_width = bit_width_of(int64_t(*max) - int64_t(*min));
+    const size_t for_size =
+        sizeof(header) + packed_size(values.size(), for_bit_width);
+
+    // the dictionary only pays off if it is much narrower than the range
+    std::vector<int> dictionary;
+    size_t dictionary_bit_width = 0;
+    size_t dictionary_size = SIZE_MAX;
+    if (for_bit_width > 8) {
+        dictionary.assign(values.begin(), values.end());
+        std::sort(dictionary.begin(), dictionary.end());
+        dictionary.erase(std::unique(dictionary.begin(), dictionary.end()),
+                         dictionary.end());
+        if (dictionary.size() <= kMaxDictionarySize) {
+            dictionary_bit_width = bit_width_of(dictionary.size() - 1);
+            dictionary_size = sizeof(header) +
+                              dictionary.size() * sizeof(int) +
+                              packed_size(values.size(), dictionary_bit_width);
+        }
+    }
+
+    if (std::min(for_size, dictionary_size) > encoded.size()) return 0;
+    char* payload = encoded.data() + sizeof(header);
+    if (for_size <= dictionary_size) {
+        header.encoding = BlockEncoding::FrameOfReference;
+        header.bit_width = for_bit_width;
+        header.reference = *min;
+        const int64_t reference = *min;
+        pack_codes(values.size(), for_bit_width,
+                   [&](size_t i) { return uint32_t(values[i] - reference); },
+                   payload);
+    } else {
+        header.encoding = BlockEncoding::Dictionary;
+        header.bit_width = dictionary_bit_width;
+        header.dictionary_size = dictionary.size();
+        memcpy(payload, dictionary.data(), dictionary.size() * sizeof(int));
+        pack_codes(values.size(), dictionary_bit_width,
+                   [&](size_t i) {
+                       return uint32_t(std::lower_bound(dictionary.begin(),
+                                                        dictionary.end(),
+                                                        values[i]) -
+                                       dictionary.begin());
+                   },
+                   payload + dictionary.size() * sizeof(int));
+    }
+    memcpy(encoded.data(), &header, sizeof(header));
+    return std::min(for_size, dictionary_size);
+}
+
+absl::StatusOr<BlockEncoding> get_block_encoding(
+    std::span<const char> encoded) {
+    EncodedBlockHeader header;
+    auto res = check_header(encoded, header, "get_block_encoding");
+    if (!res.ok()) return res;
+    return header.encoding;
+}
+
+absl::Status decode_block(std::span<const char> encoded,
+                          std::span<int> values) {
+    EncodedBlockHeader header;
+    auto res = check_header(encoded, header, "decode_block");
+    if (!res.ok()) return res;
+    if (header.value_count > values.size()) {
+        return absl::InvalidArgumentError(
+            "decode_block error: values are shorter than the block");
+    }
+
+    const char* payload = encoded.data() + sizeof(header);
+    if (header.encoding == BlockEncoding::FrameOfReference) {
+        for (size_t i = 0; i < header.value_count; ++i) {
+            values[i] = header.reference +
+                        int64_t(read_code(payload, header.bit_width, i));
+        }
+        return absl::OkStatus();
+    }
+
+    const int* dictionary = reinterpret_cast<const int*>(payload);
+    const char* packed = payload + header.dictionary_size * sizeof(int);
+    for (size_t i = 0; i < header.value_count; ++i) {
+        const uint32_t code = read_code(packed, header.bit_width, i);
+        if (code >= header.dictionary_size) {
+            return absl::DataLossError(
+                "decode_block error: code is out of the dictionary");
+        }
+        values[i] = dictionary[code];
+    }
+    return absl::OkStatus();
+}
+
+absl::StatusOr<size_t> encoded_less_than_bitmap(std::span<const char> encoded,
+                                                size_t value_count, int bound,
+                                                std::span<uint64_t> bitmap,
+                                                PredicateKernel kernel) {
+    if (bitmap.size() < bitmap_word_count(value_count)) {
+        return absl::InvalidArgumentError(
+            "encoded_less_than_bitmap error: bitmap is shorter than the block");
+    }
+    EncodedBlockHeader header;
+    auto res = check_header(encoded, header, "encoded_less_than_bitmap");
+    if (!res.ok()) return res;
+    // a shorter block would leave stale words in bitmap, a longer one would
+    // write past it
+    if (header.value_count != value_count) {
+        return absl::DataLossError(
+            "encoded_less_than_bitmap error: value count doesn't match the "
+            "block");
+    }
+    const char* payload = encoded.data() + sizeof(header);
+    const uint64_t max_code = (uint64_t(1) << header.bit_width) - 1;
+
+    int64_t threshold = 0;
+    const char* packed = payload;
+    if (header.encoding == BlockEncoding::FrameOfReference) {
+        threshold = int64_t(bound) - header.reference;
+    } else {
+        const int* dictionary = reinterpret_cast<const int*>(payload);
+        threshold = std::lower_bound(dictionary,
+                                     dictionary + header.dictionary_size,
+                                     bound) -
+                    dictionary;
+        packed = payload + header.dictionary_size * sizeof(int);
+    }
+
+    if (threshold <= 0) {
+        std::fill(bitmap.begin(),
+                  bitmap.begin() + bitmap_word_count(value_count), 0);
+        return 0;
+    }
+    if (uint64_t(threshold) > max_code) return fill_bitmap(value_count, bitmap);
+    return packed_less_than(packed, header.bit_width, value_count,
+                            static_cast<uint32_t>(threshold), bitmap, kernel);
+}
@@ -0,0 +1,364 @@
+#include <block_trace.h>
+#include <io_stats.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace {
+
+std::atomic<uint64_t> next_recorder_id{1};
+
+struct AlignedFree {
+    void operator()(char* buffer) const { free(buffer); }
+};
+
+}  // namespace
+
+// Single-producer single-consumer ring: the thread leasing it writes slots
+// and publishes them with head, the flusher reads them and frees them with
+// tail. Both run on their own cache line. Giving the lease back releases
+// head to the next thread taking it.
+struct TraceRecorder::Ring {
+    std::unique_ptr<TraceRecord[]> records;
+    const size_t mask;
+    const uint16_t index;
+    std::atomic<bool> leased{true};
+    alignas(64) std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> dropped{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+
+    Ring(size_t capacity, uint16_t index)
+        : records(new TraceRecord[capacity]), mask(capacity - 1), index(index) {}
+};
+
+// ring is set once, before ready is
+struct TraceRecorder::RingSlot {
+    std::shared_ptr<Ring> ring;
+    std::atomic<bool> ready{false};
+};
+
+// The ring a thread records into. It shares the ring with the recorder, so
+// that a thread outliving the recorder can still give it back.
+struct TraceRecorder::RingLease {
+    uint64_t recorder_id = 0;
+    std::shared_ptr<Ring> ring;
+
+    ~RingLease() { release(); }
+    void release() {
+        if (ring != nullptr) ring->leased.store(false, std::memory_order_release);
+        ring.reset();
+        recorder_id = 0;
+    }
+};
+
+TraceRecorder::TraceRecorder(std::ofstream out, size_t ring_capacity)
+    : id(next_recorder_id.fetch_add(1)),
+      epoch(Clock::now()),
+      ring_capacity(ring_capacity),
+      ring_slots(new RingSlot[kMaxTraceRings]),
+      out(std::move(out)) {}
+
+absl::StatusOr<std::shared_ptr<TraceRecorder>> TraceRecorder::open(
+    const std::filesystem::path& path, size_t ring_capacity,
+    std::chrono::milliseconds flush_interval) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (out.fail()) {
+        return absl::UnavailableError(
+            "TraceRecorder::open error: ofstream open failed");
+    }
+    const TraceFileHeader header = {kTraceMagic, kTraceVersion,
+                                    sizeof(TraceRecord), 0};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (out.fail()) {
+        return absl::UnknownError("TraceRecorder::open error: writing failed");
+    }
+    // a power of two, so that a slot is a mask away from the position
+    ring_capacity = std::bit_ceil(std::max<size_t>(ring_capacity, 2));
+    std::shared_ptr<TraceRecorder> recorder(
+        new TraceRecorder(std::move(out), ring_capacity));
+
+    TraceRecorder* raw = recorder.get();
+    recorder->flush_thread = std::thread([raw, flush_interval] {
+        std::unique_lock lock(raw->flush_mutex);
+        // flushes once more after the stop, even if it comes before the
+        // thread got to run
+        for (;;) {
+            const bool stopped = raw->flush_cv.wait_for(
+                lock, flush_interval, [raw] { return raw->flush_stopped; });
+            auto res = raw->flush_locked();
+            if (!res.ok()) raw->flush_status = res;
+            if (stopped) return;
+        }
+    });
+    return recorder;
+}
+
+TraceRecorder::~TraceRecorder() {
+    {
+        std::lock_guard lock(flush_mutex);
+        flush_stopped = true;
+    }
+    flush_cv.notify_all();
+    if (flush_thread.joinable()) flush_thread.join();
+}
+
+TraceRecorder::Ring* TraceRecorder::get_ring() {
+    // one recorder is traced into at a time, so a thread leases one ring
+    thread_local RingLease lease;
+    if (lease.recorder_id == id) return lease.ring.get();
+    lease.release();
+
+    const size_t slot_count = std::min(
+        ring_slot_count.load(std::memory_order_acquire), kMaxTraceRings);
+    for (size_t i = 0; i < slot_count && lease.ring == nullptr; ++i) {
+        const RingSlot& slot = ring_slots[i];
+        if (!slot.ready.load(std::memory_order_acquire)) continue;
+        bool leased = false;
+        if (slot.ring->leased.compare_exchange_strong(
+                leased, true, std::memory_order_acquire)) {
+            lease.ring = slot.ring;
+        }
+    }
+    if (lease.ring == nullptr) {
+        const size_t index =
+            ring_slot_count.fetch_add(1, std::memory_order_acq_rel);
+        if (index >= kMaxTraceRings) return nullptr;
+        RingSlot& slot = ring_slots[index];
+        slot.ring = std::make_shared<Ring>(ring_capacity,
+                                           static_cast<uint16_t>(index));
+        slot.ready.store(true, std::memory_order_release);
+        lease.ring = slot.ring;
+    }
+    lease.recorder_id = id;
+    return lease.ring.get();
+}
+
+void TraceRecorder::record(TraceOperation operation, uint64_t block_id,
+                           size_t device, Clock::time_point start,
+                           Clock::time_point end) {
+    Ring* leased_ring = get_ring();
+    if (leased_ring == nullptr) {
+        ringless_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Ring& ring = *leased_ring;
+    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) > ring.mask) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    const uint64_t latency =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count();
+    TraceRecord& record = ring.records[head & ring.mask];
+    record.timestamp =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch)
+            .count();
+    record.block_id = block_id;
+    record.latency = static_cast<uint32_t>(std::min<uint64_t>(
+        latency, std::numeric_limits<uint32_t>::max()));
+    record.device = static_cast<uint16_t>(device);
+    record.thread = ring.index;
+    record.operation = operation;
+    memset(record.reserved, 0, sizeof(record.reserved));
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+absl::Status TraceRecorder::flush() {
+    std::lock_guard lock(flush_mutex);
+    return flush_locked();
+}
+
+absl::Status TraceRecorder::flush_locked() {
+    flush_buffer.clear();
+    const size_t slot_count = std::min(
+        ring_slot_count.load(std::memory_order_acquire), kMaxTraceRings);
+    for (size_t i = 0; i < slot_count; ++i) {
+        if (!ring_slots[i].ready.load(std::memory_order_acquire)) continue;
+        Ring& ring = *ring_slots[i].ring;
+        const uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        const uint64_t head = ring.head.load(std::memory_order_acquire);
+        for (uint64_t position = tail; position < head; ++position) {
+            flush_buffer.emplace_back(ring.records[position & ring.mask]);
+        }
+        ring.tail.store(head, std::memory_order_release);
+    }
+    if (flush_buffer.empty()) return absl::OkStatus();
+    recorded_count.fetch_add(flush_buffer.size(), std::memory_order_relaxed);
+    out.write(reinterpret_cast<const char*>(flush_buffer.data()),
+              flush_buffer.size() * sizeof(TraceRecord));
+    out.flush();
+    if (out.fail()) {
+        return absl::UnknownError("TraceRecorder::flush error: writing failed");
+    }
+    return absl::OkStatus();
+}
+
+uint64_t TraceRecorder::get_recorded_count() const {
+    return recorded_count.load(std::memory_order_relaxed);
+}
+
+uint64_t TraceRecorder::get_dropped_count() const {
+    uint64_t dropped = ringless_dropped.load(std::memory_order_relaxed);
+    const size_t slot_count = std::min(
+        ring_slot_count.load(std::memory_order_acquire), kMaxTraceRings);
+    for (size_t i = 0; i < slot_count; ++i) {
+        if (!ring_slots[i].ready.load(std::memory_order_acquire)) continue;
+        dropped += ring_slots[i].ring->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+size_t TraceRecorder::get_ring_count() const {
+    const size_t slot_count = std::min(
+        ring_slot_count.load(std::memory_order_acquire), kMaxTraceRings);
+    size_t ring_count = 0;
+    for (size_t i = 0; i < slot_count; ++i) {
+        ring_count += ring_slots[i].ready.load(std::memory_order_acquire);
+    }
+    return ring_count;
+}
+
+absl::Status TraceRecorder::get_flush_status() {
+    std::lock_guard lock(flush_mutex);
+    return flush_status;
+}
+
+absl::StatusOr<std::vector<TraceRecord>> read_trace(
+    const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (in.fail()) {
+        return absl::NotFoundError("read_trace error: ifstream open failed");
+    }
+    TraceFileHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (in.fail() || header.magic != kTraceMagic ||
+        header.version != kTraceVersion ||
+        header.record_size != sizeof(TraceRecord)) {
+        return absl::DataLossError("read_trace error: not a trace file");
+    }
+    std::error_code error;
+    const size_t file_size = std::filesystem::file_size(path, error);
+    if (error) {
+        return absl::UnavailableError("read_trace error: file_size failed");
+    }
+    // a torn tail of a recorder that didn't stop is ignored
+    std::vector<TraceRecord> trace((file_size - sizeof(header)) /
+                                   sizeof(TraceRecord));
+    in.read(reinterpret_cast<char*>(trace.data()),
+            trace.size() * sizeof(TraceRecord));
+    if (in.fail()) {
+        return absl::DataLossError("read_trace error: reading failed");
+    }
+    std::stable_sort(trace.begin(), trace.end(),
+                     [](const TraceRecord& lhs, const TraceRecord& rhs) {
+                         return lhs.timestamp < rhs.timestamp;
+                     });
+    return trace;
+}
+
+ReplayResult replay_trace(StorageEngine& storage_engine,
+                          std::span<const TraceRecord> trace,
+                          const ReplayOptions& options) {
+    using Clock = std::chrono::steady_clock;
+    const size_t thread_number = std::max<size_t>(options.thread_number, 1);
+    const double speed_factor =
+        (options.speed == ReplaySpeed::Scaled && options.speed_factor > 0)
+            ? options.speed_factor
+            : 1.0;
+    const uint64_t first_timestamp = trace.empty() ? 0 : trace[0].timestamp;
+    const size_t block_size = storage_engine.get_block_size();
+    const size_t block_count = storage_engine.get_metadata().block_count();
+
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> reads{0};
+    std::atomic<uint64_t> writes{0};
+    std::atomic<uint64_t> skipped{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<int64_t> max_lag{0};
+    LatencyHistogram latency;
+
+    const Clock::time_point replay_start = Clock::now();
+    auto replay = [&] {
+        std::unique_ptr<char, AlignedFree> write_buffer;
+        if (options.replay_writes) {
+            write_buffer.reset(
+                static_cast<char*>(std::aligned_alloc(512, block_size)));
+            if (write_buffer != nullptr) {
+                memset(write_buffer.get(), 0, block_size);
+            }
+        }
+        for (size_t i = next.fetch_add(1); i < trace.size();
+             i = next.fetch_add(1)) {
+            const TraceRecord& record = trace[i];
+            if (options.speed != ReplaySpeed::Maximum) {
+                const auto offset = std::chrono::nanoseconds(
+                    static_cast<int64_t>((record.timestamp - first_timestamp) /
+                                         speed_factor));
+                const Clock::time_point due = replay_start + offset;
+                std::this_thread::sleep_until(due);
+                const int64_t lag =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - due)
+                        .count();
+                int64_t current = max_lag.load(std::memory_order_relaxed);
+                while (lag > current &&
+                       !max_lag.compare_exchange_weak(current, lag)) {
+                }
+            }
+
+            const bool is_write = record.operation == TraceOperation::Write;
+            if (record.block_id >= block_count ||
+                (is_write && write_buffer == nullptr)) {
+                skipped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            const Clock::time_point start = Clock::now();
+            bool ok;
+            if (is_write) {
+                ok = storage_engine.write(write_buffer.get(), record.block_id)
+                         .ok();
+                writes.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                ok = storage_engine.get_block(record.block_id).ok();
+                reads.fetch_add(1, std::memory_order_relaxed);
+            }
+            latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               Clock::now() - start)
+                               .count());
+            if (!ok) failed.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_number; ++t) threads.emplace_back(replay);
+    for (auto& thread : threads) thread.join();
+
+    ReplayResult result;
+    result.reads = reads;
+    result.writes = writes;
+    result.skipped = skipped;
+    result.failed = failed;
+    result.elapsed =
+        std::chrono::duration<double>(Clock::now() - replay_start).count();
+    result.max_lag = max_lag.load() * 1e-9;
+    result.latency = latency.snapshot();
+    return result;
+}
@@ -0,0 +1,109 @@
+#include <buffer_pool.h>
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace {
+
+constexpr size_t kBufferAlignment = 512;
+constexpr size_t kPageSize = 4096;
+constexpr size_t kHugePageSize = size_t(2) * 1024 * 1024;
+
+size_t round_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+BufferPool::BufferPool(size_t buffer_size, size_t buffer_count)
+    : buffer_size(buffer_size),
+      buffer_count(buffer_count),
+      arena(nullptr),
+      arena_size(0),
+      hugepages(false) {}
+
+absl::StatusOr<std::shared_ptr<BufferPool>> BufferPool::create(
+    size_t buffer_size, size_t buffer_count, bool use_hugepages) {
+    if (buffer_size == 0 || buffer_size % kBufferAlignment != 0) {
+        return absl::InvalidArgumentError(
+            "BufferPool::create error: buffer size must be a multiple of 512");
+    }
+    std::shared_ptr<BufferPool> pool(new BufferPool(buffer_size, buffer_count));
+    if (buffer_count == 0) return pool;
+
+    void* arena = MAP_FAILED;
+    if (use_hugepages) {
+        pool->arena_size = round_up(buffer_size * buffer_count, kHugePageSize);
+        arena = mmap(nullptr, pool->arena_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        pool->hugepages = (arena != MAP_FAILED);
+    }
+    if (arena == MAP_FAILED) {
+        pool->arena_size = round_up(buffer_size * buffer_count,
+                                    use_hugepages ? kHugePageSize : kPageSize);
+        arena = mmap(nullptr, pool->arena_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena == MAP_FAILED) {
+            return absl::ResourceExhaustedError(
+                "BufferPool::create error: mapping the arena failed");
+        }
+        if (use_hugepages) {
+            // no reserved hugepages, ask for transparent ones instead
+            pool->hugepages =
+                (madvise(arena, pool->arena_size, MADV_HUGEPAGE) == 0);
+        }
+    }
+    pool->arena = reinterpret_cast<char*>(arena);
+
+    pool->free_buffers.reserve(buffer_count);
+    // hand out low addresses first
+    for (size_t i = buffer_count; i > 0; --i) {
+        pool->free_buffers.emplace_back(pool->arena + (i - 1) * buffer_size);
+    }
+    return pool;
+}
+
+BufferPool::~BufferPool() {
+    if (arena != nullptr) munmap(arena, arena_size);
+}
+
+char* BufferPool::acquire() {
+    {
+        std::lock_guard lock(mutex);
+        if (!free_buffers.empty()) {
+            char* buffer = free_buffers.back();
+            free_buffers.pop_back();
+            return buffer;
+        }
+    }
+    return reinterpret_cast<char*>(aligned_alloc(kBufferAlignment, buffer_size));
+}
+
+void BufferPool::release(char* buffer) {
+    if (buffer == nullptr) return;
+    if (arena == nullptr || buffer < arena ||
+        buffer >= arena + buffer_size * buffer_count) {
+        free(buffer);
+        return;
+    }
+    std::lock_guard lock(mutex);
+    free_buffers.emplace_back(buffer);
+}
+
+size_t BufferPool::get_buffer_size() const { return buffer_size; }
+
+size_t BufferPool::get_buffer_count() const { return buffer_count; }
+
+size_t BufferPool::get_free_buffer_count() {
+    std::lock_guard lock(mutex);
+    return free_buffers.size();
+}
+
+bool BufferPool::uses_hugepages() const { return hugepages; }
@@ -0,0 +1,135 @@
+#include <device_topology.h>
+#include <storage_engine.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace {
+
+// weights are rounded to integers in [1, kWeightResolution] relative to the
+// largest one, which bounds the length of the placement cycle
+constexpr size_t kWeightResolution = 64;
+
+}  // namespace
+
+DeviceConfig::DeviceConfig(const std::string& path, size_t capacity,
+                           double weight)
+    : path(path), capacity(capacity), weight(weight) {}
+
+DeviceTopology::DeviceTopology(const std::vector<DeviceConfig>& devices)
+    : devices(devices) {}
+
+DeviceTopology DeviceTopology::default_topology() {
+    std::vector<DeviceConfig> devices;
+    for (auto& disk_path : disk_pathes) {
+        devices.emplace_back(disk_path);
+    }
+    return DeviceTopology(devices);
+}
+
+absl::StatusOr<DeviceTopology> DeviceTopology::create(
+    const std::vector<DeviceConfig>& devices) {
+    if (devices.empty()) {
+        return absl::InvalidArgumentError(
+            "DeviceTopology::create error: no devices");
+    }
+    for (auto& device : devices) {
+        if (!(device.weight > 0) || !std::isfinite(device.weight)) {
+            return absl::InvalidArgumentError(
+                "DeviceTopology::create error: weights must be positive");
+        }
+    }
+    return DeviceTopology(devices);
+}
+
+absl::StatusOr<DeviceTopology> DeviceTopology::load(
+    const std::filesystem::path& config_path) {
+    std::ifstream in;
+    in.open(config_path);
+    if (in.fail()) {
+        return absl::UnavailableError(
+            "DeviceTopology::load error: ifstream open failed");
+    }
+
+    std::vector<DeviceConfig> devices;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string path, capacity, weight;
+        if (!std::getline(fields, path, ',') ||
+            !std::getline(fields, capacity, ',') ||
+            !std::getline(fields, weight)) {
+            return absl::InvalidArgumentError(
+                "DeviceTopology::load error: expected <path>,<capacity>,"
+                "<weight>");
+        }
+        try {
+            devices.emplace_back(path, std::stoull(capacity), std::stod(weight));
+        } catch (const std::exception&) {
+            return absl::InvalidArgumentError(
+                "DeviceTopology::load error: malformed capacity or weight");
+        }
+    }
+    return create(devices);
+}
+
+size_t DeviceTopology::size() const { return devices.size(); }
+
+const std::vector<DeviceConfig>& DeviceTopology::get_devices() const {
+    return devices;
+}
+
+const DeviceConfig& DeviceTopology::get_device(size_t file_id) const {
+    return devices[file_id];
+}
+
+bool DeviceTopology::is_uniform() const {
+    for (auto& device : devices) {
+        if (device.weight != devices[0].weight) return false;
+    }
+    return true;
+}
+
+std::vector<size_t> DeviceTopology::placement_cycle() const {
+    double max_weight = 0;
+    for (auto& device : devices) {
+        max_weight = std::max(max_weight, device.weight);
+    }
+    std::vector<long> weights;
+    long divisor = 0;
+    for (auto& device : devices) {
+        long weight = std::lround(device.weight / max_weight * kWeightResolution);
+        weights.emplace_back(std::max(weight, 1L));
+        divisor = std::gcd(divisor, weights.back());
+    }
+    long total = 0;
+    for (auto& weight : weights) {
+        weight /= divisor;
+        total += weight;
+    }
+
+    std::vector<size_t> cycle;
+    cycle.reserve(total);
+    std::vector<long> current(devices.size(), 0);
+    for (long step = 0; step < total; ++step) {
+        size_t best = 0;
+        for (size_t i = 0; i < devices.size(); ++i) {
+            current[i] += weights[i];
+            if (current[i] > current[best]) best = i;
+        }
+        current[best] -= total;
+        cycle.emplace_back(best);
+    }
+    return cycle;
+}
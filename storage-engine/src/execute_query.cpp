@@ -1,9 +1,20 @@
+#include <block_encoding.h>
 #include <execute_query.h>
+#include <io_scheduler.h>
+#include <morsel_executor.h>
+#include <predicate.h>
+#include <table.h>
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <future>
 #include <iostream>
+#include <span>
+#include <type_traits>
 #include <vector>
 
 #include "absl/status/status.h"
@@ -12,38 +23,339 @@
 #include "storage_engine.h"
 
 
+namespace {
+
+// selection bitmap of a column-A block that the zone map doesn't decide;
+// an encoded block is filtered without decoding it
+absl::StatusOr<size_t> filter_block(const StorageEngine& storage_engine,
+                                    StorageEngine::BlockId block_id,
+                                    const BlockZoneMap& zone_map,
+                                    int upper_bound,
+                                    std::vector<uint64_t>& bitmap) {
+    if (zone_map.encoding != BlockEncoding::Plain) {
+        const auto get_block_res = storage_engine.get_encoded_block(block_id);
+        if (!get_block_res.ok()) return get_block_res.status();
+        return encoded_less_than_bitmap(
+            get_block_res->view<char>(),
+            storage_engine.get_block_size() / sizeof(int), upper_bound,
+            std::span<uint64_t>(bitmap));
+    }
+    const auto get_block_res = storage_engine.get_block(block_id);
+    if (!get_block_res.ok()) return get_block_res.status();
+    return less_than_bitmap(get_block_res->view<int>(), upper_bound,
+                            std::span<uint64_t>(bitmap));
+}
+
+// counts col_b_block_id in cnt if the query has to load it
+absl::Status count_position(const StorageEngine& storage_engine,
+                            StorageEngine::BlockId col_a_block_id,
+                            StorageEngine::BlockId col_b_block_id,
+                            int upper_bound, std::vector<size_t>& cnt) {
+    // blocks the zone map decides are not read
+    const BlockZoneMap zone_map = storage_engine.get_zone_map(col_a_block_id);
+    if (!zone_map.may_have_less_than(upper_bound)) return absl::OkStatus();
+    if (zone_map.all_less_than(upper_bound)) {
+        return storage_engine.counting_get_block(col_b_block_id, cnt);
+    }
+
+    if (zone_map.encoding != BlockEncoding::Plain) {
+        std::vector<uint64_t> bitmap(bitmap_word_count(
+            storage_engine.get_block_size() / sizeof(int)));
+        auto filter_res = filter_block(storage_engine, col_a_block_id,
+                                       zone_map, upper_bound, bitmap);
+        if (!filter_res.ok()) return filter_res.status();
+        if (*filter_res == 0) return absl::OkStatus();
+        return storage_engine.counting_get_block(col_b_block_id, cnt);
+    }
+
+    const auto get_block_a_res = storage_engine.get_block(col_a_block_id);
+    if (!get_block_a_res.ok()) return get_block_a_res.status();
+    // only whether column B is needed matters for counting
+    if (any_less_than(get_block_a_res->view<int>(), upper_bound)) {
+        return storage_engine.counting_get_block(col_b_block_id, cnt);
+    }
+    return absl::OkStatus();
+}
+
+// adds the values of col_b_block_id whose col_a_block_id value passes to sum;
+// bitmap is scratch space of the calling worker
+absl::Status sum_position(const StorageEngine& storage_engine,
+                          StorageEngine::BlockId col_a_block_id,
+                          StorageEngine::BlockId col_b_block_id,
+                          int upper_bound, std::vector<uint64_t>& bitmap,
+                          int64_t& sum) {
+    const BlockZoneMap zone_map = storage_engine.get_zone_map(col_a_block_id);
+    if (!zone_map.may_have_less_than(upper_bound)) return absl::OkStatus();
+
+    const size_t block_value_count =
+        storage_engine.get_block_size() / sizeof(int);
+    bitmap.resize(bitmap_word_count(block_value_count));
+    if (zone_map.all_less_than(upper_bound)) {
+        // every row passes, column A doesn't have to be read
+        std::fill(bitmap.begin(), bitmap.end(), ~uint64_t(0));
+    } else {
+        auto filter_res = filter_block(storage_engine, col_a_block_id,
+                                       zone_map, upper_bound, bitmap);
+        if (!filter_res.ok()) return filter_res.status();
+        if (*filter_res == 0) return absl::OkStatus();
+    }
+
+    const auto get_block_b_res = storage_engine.get_block(col_b_block_id);
+    if (!get_block_b_res.ok()) return get_block_b_res.status();
+    sum += masked_sum(get_block_b_res->view<int>(), bitmap);
+    return absl::OkStatus();
+}
+
+// sum_position over block `block` of two typed columns
+template <typename A, typename B>
+absl::Status sum_column_block(const Column<A>& col_a, const Column<B>& col_b,
+                              size_t block, A upper_bound,
+                              std::vector<uint64_t>& bitmap, SumType<B>& sum) {
+    const size_t row_count = col_a.get_block_row_count(block);
+    bitmap.resize(bitmap_word_count(row_count));
+    bool all_pass = false;
+    if constexpr (std::is_same_v<A, int32_t>) {
+        // the zone map covers the padding too, which only makes it looser
+        const BlockZoneMap zone_map =
+            col_a.get_storage_engine().get_zone_map(col_a.get_block_id(block));
+        if (!zone_map.may_have_less_than(upper_bound)) return absl::OkStatus();
+        all_pass = zone_map.all_less_than(upper_bound);
+    }
+    if (all_pass) {
+        std::fill(bitmap.begin(), bitmap.end(), ~uint64_t(0));
+        if (row_count % 64 != 0) {
+            bitmap.back() = (uint64_t(1) << (row_count % 64)) - 1;
+        }
+    } else {
+        auto block_a_res = col_a.read_block(block);
+        if (!block_a_res.ok()) return block_a_res.status();
+        const size_t passed = less_than_bitmap(block_a_res->values(),
+                                               upper_bound,
+                                               std::span<uint64_t>(bitmap));
+        if (passed == 0) return absl::OkStatus();
+    }
+
+    auto block_b_res = col_b.read_block(block);
+    if (!block_b_res.ok()) return block_b_res.status();
+    sum += masked_sum(block_b_res->values(), bitmap);
+    return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<int64_t> execute_query(
+    StorageEngine& storage_engine, long long& time,
+    const std::vector<StorageEngine::BlockId>& col_a,
+    const std::vector<StorageEngine::BlockId>& col_b, int upper_bound,
+    size_t thread_number) {
+    const auto start = std::chrono::steady_clock::now();
+    if (thread_number == 0) thread_number = 1;
+    MorselExecutor executor(storage_engine, col_a);
+    std::vector<int64_t> worker_sum(thread_number, 0);
+    std::vector<std::vector<uint64_t>> worker_bitmap(thread_number);
+
+    auto res = executor.run(
+        thread_number,
+        [&](size_t worker, std::span<const size_t> positions) -> absl::Status {
+            for (size_t t : positions) {
+                auto res = sum_position(storage_engine, col_a[t], col_b[t],
+                                        upper_bound, worker_bitmap[worker],
+                                        worker_sum[worker]);
+                if (!res.ok()) return res;
+            }
+            return absl::OkStatus();
+        });
+    if (!res.ok()) return res;
+
+    int64_t sum = 0;
+    for (auto local_sum : worker_sum) sum += local_sum;
+    time = std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start)
+               .count();
+    return sum;
+}
+
+template <typename A, typename B>
+absl::StatusOr<SumType<B>> execute_query(const Column<A>& col_a,
+                                         const Column<B>& col_b, A upper_bound,
+                                         size_t thread_number) {
+    if (col_a.get_row_count() != col_b.get_row_count() ||
+        col_a.get_rows_per_block() != col_b.get_rows_per_block()) {
+        return absl::InvalidArgumentError(
+            "execute_query error: columns don't have the same rows per block");
+    }
+    if (thread_number == 0) thread_number = 1;
+    const std::vector<StorageEngine::BlockId> col_a_block_ids =
+        col_a.get_block_ids();
+    MorselExecutor executor(col_a.get_storage_engine(), col_a_block_ids);
+    std::vector<SumType<B>> worker_sum(thread_number, 0);
+    std::vector<std::vector<uint64_t>> worker_bitmap(thread_number);
+
+    auto res = executor.run(
+        thread_number,
+        [&](size_t worker, std::span<const size_t> positions) -> absl::Status {
+            for (size_t t : positions) {
+                auto res = sum_column_block(col_a, col_b, t, upper_bound,
+                                            worker_bitmap[worker],
+                                            worker_sum[worker]);
+                if (!res.ok()) return res;
+            }
+            return absl::OkStatus();
+        });
+    if (!res.ok()) return res;
+
+    SumType<B> sum = 0;
+    for (auto local_sum : worker_sum) sum += local_sum;
+    return sum;
+}
+
+#define INSTANTIATE_COLUMN_EXECUTE_QUERY(A, B)                              \
+    template absl::StatusOr<SumType<B>> execute_query<A, B>(                \
+        const Column<A>&, const Column<B>&, A, size_t);
+INSTANTIATE_COLUMN_EXECUTE_QUERY(int32_t, int32_t)
+INSTANTIATE_COLUMN_EXECUTE_QUERY(int32_t, float)
+INSTANTIATE_COLUMN_EXECUTE_QUERY(int32_t, int64_t)
+INSTANTIATE_COLUMN_EXECUTE_QUERY(float, int32_t)
+INSTANTIATE_COLUMN_EXECUTE_QUERY(float, float)
+INSTANTIATE_COLUMN_EXECUTE_QUERY(float, int64_t)
+INSTANTIATE_COLUMN_EXECUTE_QUERY(int64_t, int32_t)
+INSTANTIATE_COLUMN_EXECUTE_QUERY(int64_t, float)
+INSTANTIATE_COLUMN_EXECUTE_QUERY(int64_t, int64_t)
+#undef INSTANTIATE_COLUMN_EXECUTE_QUERY
+
+absl::StatusOr<int64_t> pipelined_execute_query(
+    StorageEngine& storage_engine, IoScheduler& io_scheduler,
+    const std::vector<StorageEngine::BlockId>& col_a,
+    const std::vector<StorageEngine::BlockId>& col_b, int upper_bound,
+    size_t prefetch_distance) {
+    if (prefetch_distance == 0) prefetch_distance = 1;
+    using BlockFuture = std::future<absl::StatusOr<BlockReader>>;
+    struct FilterSlot {
+        size_t t;
+        bool all_pass;      // decided by the zone map, nothing is read
+        BlockFuture block;  // column A, unless all_pass
+    };
+    struct FetchSlot {
+        std::vector<uint64_t> bitmap;
+        BlockFuture block;  // column B
+    };
+
+    const size_t block_value_count =
+        storage_engine.get_block_size() / sizeof(int);
+    std::deque<FilterSlot> filter_ring;
+    std::deque<FetchSlot> fetch_ring;
+    size_t next_t = 0;
+    int64_t sum = 0;
+
+    while (next_t < col_a.size() || !filter_ring.empty() ||
+           !fetch_ring.empty()) {
+        // stage one: keep prefetch_distance column-A reads in flight
+        while (next_t < col_a.size() && filter_ring.size() < prefetch_distance) {
+            const size_t t = next_t++;
+            const BlockZoneMap zone_map = storage_engine.get_zone_map(col_a[t]);
+            if (!zone_map.may_have_less_than(upper_bound)) continue;
+            if (zone_map.all_less_than(upper_bound)) {
+                filter_ring.push_back({t, true, BlockFuture()});
+            } else {
+                filter_ring.push_back(
+                    {t, false, io_scheduler.submit_read(col_a[t])});
+            }
+        }
+
+        // stage two: the column-B read is issued as soon as the mask is known
+        if (!filter_ring.empty() && fetch_ring.size() < prefetch_distance) {
+            FilterSlot slot = std::move(filter_ring.front());
+            filter_ring.pop_front();
+            std::vector<uint64_t> bitmap(bitmap_word_count(block_value_count),
+                                         ~uint64_t(0));
+            if (!slot.all_pass) {
+                auto block_a_res = slot.block.get();
+                if (!block_a_res.ok()) return block_a_res.status();
+                const size_t passed = less_than_bitmap(
+                    block_a_res->view<int>(), upper_bound,
+                    std::span<uint64_t>(bitmap));
+                if (passed == 0) continue;
+            }
+            fetch_ring.push_back(
+                {std::move(bitmap), io_scheduler.submit_read(col_b[slot.t])});
+            continue;
+        }
+
+        // the zone maps may have dropped all of the remaining positions
+        if (fetch_ring.empty()) continue;
+        FetchSlot slot = std::move(fetch_ring.front());
+        fetch_ring.pop_front();
+        auto block_b_res = slot.block.get();
+        if (!block_b_res.ok()) return block_b_res.status();
+        sum += masked_sum(block_b_res->view<int>(), slot.bitmap);
+    }
+    return sum;
+}
+
 absl::Status counting_execute_query(
     StorageEngine& storage_engine,
     const std::vector<StorageEngine::BlockId>& col_a,
     const std::vector<StorageEngine::BlockId>& col_b, int upper_bound,
     std::vector<size_t>& cnt) {
-    const size_t block_size = storage_engine.get_block_size();
-    const size_t block_value_count = block_size / sizeof(int);
+    for (int t = 0; t < col_a.size(); ++t) {
+        auto res =
+            count_position(storage_engine, col_a[t], col_b[t], upper_bound, cnt);
+        if (!res.ok()) return res;
+    }
 
-    std::vector<bool> block_mask;
-    int sum = 0;
+    return absl::OkStatus();
+}
+
+absl::Status parallel_counting_execute_query(
+    StorageEngine& storage_engine,
+    const std::vector<StorageEngine::BlockId>& col_a,
+    const std::vector<StorageEngine::BlockId>& col_b, int upper_bound,
+    std::vector<size_t>& cnt, size_t thread_number, size_t morsel_size) {
+    if (thread_number == 0) thread_number = 1;
+    // column A is read for every position, so it picks the home device
+    MorselExecutor executor(storage_engine, col_a, morsel_size);
+    std::vector<std::vector<size_t>> worker_cnt(
+        thread_number, std::vector<size_t>(cnt.size(), 0));
+
+    auto res = executor.run(
+        thread_number,
+        [&](size_t worker, std::span<const size_t> positions) -> absl::Status {
+            for (size_t t : positions) {
+                auto res = count_position(storage_engine, col_a[t], col_b[t],
+                                          upper_bound, worker_cnt[worker]);
+                if (!res.ok()) return res;
+            }
+            return absl::OkStatus();
+        });
+    if (!res.ok()) return res;
+
+    for (auto& local_cnt : worker_cnt) {
+        for (size_t i = 0; i < cnt.size(); ++i) cnt[i] += local_cnt[i];
+    }
+    return absl::OkStatus();
+}
+
+absl::Status block_counting_execute_query(
+    StorageEngine& storage_engine,
+    const std::vector<StorageEngine::BlockId>& col_a,
+    const std::vector<StorageEngine::BlockId>& col_b, int upper_bound,
+    std::vector<size_t>& block_cnt) {
+    block_cnt.resize(storage_engine.get_block_count(), 0);
 
     for (int t = 0; t < col_a.size(); ++t) {
-        const StorageEngine::BlockId col_a_block_id = col_a[t];
-        const StorageEngine::BlockId col_b_block_id = col_b[t];
+        const BlockZoneMap zone_map = storage_engine.get_zone_map(col_a[t]);
+        if (!zone_map.may_have_less_than(upper_bound)) continue;
+        if (zone_map.all_less_than(upper_bound)) {
+            block_cnt[col_b[t]] += 1;
+            continue;
+        }
 
-        const auto get_block_a_res = storage_engine.get_block(col_a_block_id);
-        // const auto count_result =
-        // storage_engine.counting_get_block(col_a_block_id, cnt);
-        // assert(count_result.ok() && "Counting failed");
+        const auto get_block_a_res = storage_engine.get_block(col_a[t]);
         if (!get_block_a_res.ok()) return get_block_a_res.status();
-        const auto& col_a_block_reader = *get_block_a_res;
-        block_mask.assign(block_value_count, false);
+        block_cnt[col_a[t]] += 1;
 
-        bool at_least_one_true = false;
-        for (int i = 0; i < block_value_count; ++i) {
-            block_mask[i] = (col_a_block_reader.read_int(i) < upper_bound);
-            at_least_one_true |= block_mask[i];
-        }
-        if (at_least_one_true) {
-            const auto count_result =
-                storage_engine.counting_get_block(col_b_block_id, cnt);
-            assert(count_result.ok());
+        if (any_less_than(get_block_a_res->view<int>(), upper_bound)) {
+            block_cnt[col_b[t]] += 1;
         }
     }
 
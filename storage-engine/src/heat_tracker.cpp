@@ -0,0 +1,58 @@
+#include <heat_tracker.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+HeatTracker::HeatTracker(std::chrono::milliseconds half_life)
+    : half_life(half_life), last_snapshot(Clock::now()) {}
+
+void HeatTracker::resize(size_t block_count) {
+    while (chunks.size() * kHeatChunkSize < block_count) {
+        // value-initialized, i.e. zeroed
+        chunks.emplace_back(new std::atomic<uint32_t>[kHeatChunkSize]());
+    }
+    this->block_count = block_count;
+    std::lock_guard lock(mutex);
+    heat.resize(block_count, 0);
+}
+
+void HeatTracker::set_half_life(std::chrono::milliseconds half_life) {
+    std::lock_guard lock(mutex);
+    this->half_life = half_life;
+}
+
+std::vector<double> HeatTracker::snapshot() {
+    std::lock_guard lock(mutex);
+    const auto now = Clock::now();
+    const double elapsed =
+        std::chrono::duration<double, std::milli>(now - last_snapshot).count();
+    const double factor =
+        (half_life.count() > 0) ? std::exp2(-elapsed / half_life.count()) : 0;
+    last_snapshot = now;
+
+    for (size_t block_id = 0; block_id < block_count; ++block_id) {
+        const uint32_t count =
+            chunks[block_id / kHeatChunkSize][block_id % kHeatChunkSize]
+                .exchange(0, std::memory_order_relaxed);
+        heat[block_id] = heat[block_id] * factor + count;
+    }
+    return heat;
+}
+
+void HeatTracker::reset() {
+    std::lock_guard lock(mutex);
+    for (size_t block_id = 0; block_id < block_count; ++block_id) {
+        chunks[block_id / kHeatChunkSize][block_id % kHeatChunkSize].store(
+            0, std::memory_order_relaxed);
+    }
+    heat.assign(block_count, 0);
+    last_snapshot = Clock::now();
+}
+
+size_t HeatTracker::size() const { return block_count; }
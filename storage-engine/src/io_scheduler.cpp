@@ -0,0 +1,100 @@
+#include <io_scheduler.h>
+
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+IoScheduler::IoScheduler(const StorageEngine& storage_engine,
+                         size_t workers_per_device)
+    : storage_engine(storage_engine) {
+    if (workers_per_device == 0) workers_per_device = 1;
+    const size_t number_of_devices = storage_engine.get_number_of_files();
+
+    queues.reserve(number_of_devices);
+    for (size_t i = 0; i < number_of_devices; ++i) {
+        queues.emplace_back(std::make_unique<DeviceQueue>());
+    }
+
+    workers.reserve(number_of_devices * workers_per_device);
+    for (size_t i = 0; i < number_of_devices; ++i) {
+        for (size_t j = 0; j < workers_per_device; ++j) {
+            DeviceQueue& queue = *queues[i];
+            workers.emplace_back([this, &queue] { worker_loop(queue); });
+        }
+    }
+}
+
+IoScheduler::~IoScheduler() {
+    for (auto& queue : queues) {
+        {
+            std::lock_guard lock(queue->mutex);
+            queue->stopped = true;
+        }
+        queue->cv.notify_all();
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void IoScheduler::worker_loop(DeviceQueue& queue) {
+    while (true) {
+        std::unique_lock lock(queue.mutex);
+        queue.cv.wait(lock,
+                      [&] { return queue.stopped || !queue.requests.empty(); });
+        if (queue.requests.empty()) return;  // stopped and drained
+
+        Request request = std::move(queue.requests.front());
+        queue.requests.pop_front();
+        lock.unlock();
+
+        auto block_res = storage_engine.get_block(request.block_id);
+        // release the slot before waking the caller, so that a caller that
+        // waited for all its reads observes the drained queue
+        queue.depth.fetch_sub(1, std::memory_order_release);
+        request.promise.set_value(std::move(block_res));
+    }
+}
+
+std::future<absl::StatusOr<BlockReader>> IoScheduler::submit_read(
+    StorageEngine::BlockId block_id) {
+    Request request{block_id, {}};
+    auto future = request.promise.get_future();
+
+    if (block_id >= storage_engine.get_block_count()) {
+        request.promise.set_value(absl::UnavailableError(
+            "IoScheduler::submit_read error: invalid block_id"));
+        return future;
+    }
+
+    DeviceQueue& queue = *queues[storage_engine.get_block_file_id(block_id)];
+    queue.depth.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.requests.emplace_back(std::move(request));
+    }
+    queue.cv.notify_one();
+    return future;
+}
+
+size_t IoScheduler::get_number_of_devices() const { return queues.size(); }
+
+size_t IoScheduler::get_queue_depth(size_t file_id) const {
+    return queues[file_id]->depth.load(std::memory_order_relaxed);
+}
+
+std::vector<size_t> IoScheduler::get_queue_depths() const {
+    std::vector<size_t> depths;
+    depths.reserve(queues.size());
+    for (size_t i = 0; i < queues.size(); ++i) {
+        depths.emplace_back(get_queue_depth(i));
+    }
+    return depths;
+}
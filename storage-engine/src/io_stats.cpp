@@ -0,0 +1,205 @@
+#include <io_stats.h>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+
+size_t LatencyHistogram::bucket_index(uint64_t value) {
+    // values below kSubBucketCount get a bucket each
+    if (value < kSubBucketCount) return value;
+    const size_t exponent = 63 - std::countl_zero(value);
+    const size_t sub_bucket =
+        (value >> (exponent - kSubBucketBits)) & (kSubBucketCount - 1);
+    return (exponent - kSubBucketBits + 1) * kSubBucketCount + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(size_t index) {
+    if (index < kSubBucketCount) return index;
+    const size_t exponent = index / kSubBucketCount + kSubBucketBits - 1;
+    const uint64_t sub_bucket = index % kSubBucketCount;
+    const uint64_t width = uint64_t(1) << (exponent - kSubBucketBits);
+    return (uint64_t(1) << exponent) + (sub_bucket + 1) * width - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    counts[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() {
+    for (auto& count : counts) count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+}
+
+std::vector<uint64_t> LatencyHistogram::snapshot() const {
+    std::vector<uint64_t> histogram(kBucketCount);
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        histogram[i] = counts[i].load(std::memory_order_relaxed);
+    }
+    return histogram;
+}
+
+uint64_t LatencyHistogram::get_sum() const {
+    return sum.load(std::memory_order_relaxed);
+}
+
+uint64_t DeviceStatsSnapshot::percentile(
+    const std::vector<uint64_t>& histogram, double q) {
+    uint64_t total = 0;
+    for (auto count : histogram) total += count;
+    if (total == 0) return 0;
+
+    const uint64_t rank = std::max<uint64_t>(1, std::ceil(q * total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogram.size(); ++i) {
+        seen += histogram[i];
+        if (seen >= rank) return LatencyHistogram::bucket_upper_bound(i);
+    }
+    return LatencyHistogram::bucket_upper_bound(histogram.size() - 1);
+}
+
+IoStats::IoStats(size_t number_of_devices) {
+    for (size_t i = 0; i < number_of_devices; ++i) {
+        devices.emplace_back(std::make_unique<DeviceCounters>());
+    }
+}
+
+IoStats::~IoStats() { stop_dump(); }
+
+IoStats::Clock::time_point IoStats::begin_io(size_t file_id) {
+    devices[file_id]->in_flight.fetch_add(1, std::memory_order_relaxed);
+    return Clock::now();
+}
+
+void IoStats::end_read(size_t file_id, Clock::time_point start,
+                       size_t bytes) {
+    const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start);
+    DeviceCounters& device = *devices[file_id];
+    device.read_latency.record(latency.count());
+    device.reads.fetch_add(1, std::memory_order_relaxed);
+    device.bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+    device.in_flight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void IoStats::end_write(size_t file_id, Clock::time_point start,
+                        size_t bytes) {
+    const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start);
+    DeviceCounters& device = *devices[file_id];
+    device.write_latency.record(latency.count());
+    device.writes.fetch_add(1, std::memory_order_relaxed);
+    device.bytes_written.fetch_add(bytes, std::memory_order_relaxed);
+    device.in_flight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+size_t IoStats::get_number_of_devices() const { return devices.size(); }
+
+DeviceStatsSnapshot IoStats::snapshot(size_t file_id) const {
+    const DeviceCounters& device = *devices[file_id];
+    DeviceStatsSnapshot snapshot;
+    snapshot.reads = device.reads.load(std::memory_order_relaxed);
+    snapshot.writes = device.writes.load(std::memory_order_relaxed);
+    snapshot.bytes_read = device.bytes_read.load(std::memory_order_relaxed);
+    snapshot.bytes_written =
+        device.bytes_written.load(std::memory_order_relaxed);
+    snapshot.in_flight = device.in_flight.load(std::memory_order_relaxed);
+    snapshot.read_latency = device.read_latency.snapshot();
+    snapshot.write_latency = device.write_latency.snapshot();
+    return snapshot;
+}
+
+std::vector<DeviceStatsSnapshot> IoStats::snapshot() const {
+    std::vector<DeviceStatsSnapshot> snapshots;
+    for (size_t i = 0; i < devices.size(); ++i) {
+        snapshots.emplace_back(snapshot(i));
+    }
+    return snapshots;
+}
+
+void IoStats::reset() {
+    // in_flight is left alone, the I/Os running now will still end
+    for (auto& device : devices) {
+        device->read_latency.reset();
+        device->write_latency.reset();
+        device->reads.store(0, std::memory_order_relaxed);
+        device->writes.store(0, std::memory_order_relaxed);
+        device->bytes_read.store(0, std::memory_order_relaxed);
+        device->bytes_written.store(0, std::memory_order_relaxed);
+    }
+}
+
+absl::Status IoStats::dump_csv(const std::filesystem::path& path) const {
+    const bool new_file = !std::filesystem::exists(path);
+    std::ofstream out;
+    out.open(path, std::ios_base::app | std::ios_base::out);
+    if (out.fail()) {
+        return absl::UnavailableError(
+            "IoStats::dump_csv error: ofstream open failed");
+    }
+    if (new_file) {
+        out << "time_ms,device,reads,writes,bytes_read,bytes_written,"
+               "in_flight,read_p50_ns,read_p99_ns,read_max_ns,write_p50_ns,"
+               "write_p99_ns,write_max_ns\n";
+    }
+    const auto time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+    for (size_t i = 0; i < devices.size(); ++i) {
+        const DeviceStatsSnapshot s = snapshot(i);
+        out << time_ms << "," << i << "," << s.reads << "," << s.writes << ","
+            << s.bytes_read << "," << s.bytes_written << "," << s.in_flight
+            << "," << DeviceStatsSnapshot::percentile(s.read_latency, 0.5)
+            << "," << DeviceStatsSnapshot::percentile(s.read_latency, 0.99)
+            << "," << DeviceStatsSnapshot::percentile(s.read_latency, 1)
+            << "," << DeviceStatsSnapshot::percentile(s.write_latency, 0.5)
+            << "," << DeviceStatsSnapshot::percentile(s.write_latency, 0.99)
+            << "," << DeviceStatsSnapshot::percentile(s.write_latency, 1)
+            << std::endl;
+    }
+    if (out.fail()) {
+        return absl::UnknownError("IoStats::dump_csv error: writing failed");
+    }
+    return absl::OkStatus();
+}
+
+void IoStats::start_dump(const std::filesystem::path& path,
+                         std::chrono::milliseconds interval) {
+    std::lock_guard lock(dump_mutex);
+    if (!dump_stopped) return;
+    dump_stopped = false;
+    dump_thread = std::thread([this, path, interval] {
+        std::unique_lock lock(dump_mutex);
+        while (!dump_stopped) {
+            dump_cv.wait_for(lock, interval, [this] { return dump_stopped; });
+            if (dump_stopped) return;
+            auto res = dump_csv(path);
+            if (!res.ok()) dump_status = res;
+        }
+    });
+}
+
+void IoStats::stop_dump() {
+    {
+        std::lock_guard lock(dump_mutex);
+        dump_stopped = true;
+    }
+    dump_cv.notify_all();
+    if (dump_thread.joinable()) dump_thread.join();
+}
+
+absl::Status IoStats::get_dump_status() {
+    std::lock_guard lock(dump_mutex);
+    return dump_status;
+}
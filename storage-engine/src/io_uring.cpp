@@ -0,0 +1,199 @@
+#include <io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                    min_complete, flags, nullptr, 0));
+}
+
+unsigned* ring_field(void* ring_ptr, unsigned offset) {
+    return reinterpret_cast<unsigned*>(reinterpret_cast<char*>(ring_ptr) +
+                                       offset);
+}
+
+}  // namespace
+
+IoUring::IoUring()
+    : ring_fd(-1),
+      sq_ring_ptr(MAP_FAILED),
+      sq_ring_size(0),
+      cq_ring_ptr(MAP_FAILED),
+      cq_ring_size(0),
+      sqes(reinterpret_cast<io_uring_sqe*>(MAP_FAILED)),
+      sqes_size(0),
+      sq_head(nullptr),
+      sq_tail(nullptr),
+      sq_ring_mask(nullptr),
+      sq_array(nullptr),
+      cq_head(nullptr),
+      cq_tail(nullptr),
+      cq_ring_mask(nullptr),
+      cqes(nullptr),
+      sq_entries(0),
+      to_submit(0) {}
+
+absl::StatusOr<IoUring> IoUring::create(unsigned entries) {
+    IoUring ring;
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring.ring_fd = io_uring_setup(entries, &params);
+    if (ring.ring_fd < 0) {
+        return absl::UnavailableError("IoUring::create error: setup failed");
+    }
+    ring.sq_entries = params.sq_entries;
+
+    ring.sq_ring_size =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        if (ring.cq_ring_size > ring.sq_ring_size) {
+            ring.sq_ring_size = ring.cq_ring_size;
+        }
+        ring.cq_ring_size = ring.sq_ring_size;
+    }
+
+    ring.sq_ring_ptr =
+        mmap(nullptr, ring.sq_ring_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring.ring_fd, IORING_OFF_SQ_RING);
+    if (ring.sq_ring_ptr == MAP_FAILED) {
+        return absl::UnavailableError(
+            "IoUring::create error: mapping submission ring failed");
+    }
+
+    if (single_mmap) {
+        ring.cq_ring_ptr = ring.sq_ring_ptr;
+    } else {
+        ring.cq_ring_ptr =
+            mmap(nullptr, ring.cq_ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring.ring_fd, IORING_OFF_CQ_RING);
+        if (ring.cq_ring_ptr == MAP_FAILED) {
+            return absl::UnavailableError(
+                "IoUring::create error: mapping completion ring failed");
+        }
+    }
+
+    ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    ring.sqes = reinterpret_cast<io_uring_sqe*>(
+        mmap(nullptr, ring.sqes_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring.ring_fd, IORING_OFF_SQES));
+    if (ring.sqes == MAP_FAILED) {
+        return absl::UnavailableError(
+            "IoUring::create error: mapping submission entries failed");
+    }
+
+    ring.sq_head = ring_field(ring.sq_ring_ptr, params.sq_off.head);
+    ring.sq_tail = ring_field(ring.sq_ring_ptr, params.sq_off.tail);
+    ring.sq_ring_mask = ring_field(ring.sq_ring_ptr, params.sq_off.ring_mask);
+    ring.sq_array = ring_field(ring.sq_ring_ptr, params.sq_off.array);
+    ring.cq_head = ring_field(ring.cq_ring_ptr, params.cq_off.head);
+    ring.cq_tail = ring_field(ring.cq_ring_ptr, params.cq_off.tail);
+    ring.cq_ring_mask = ring_field(ring.cq_ring_ptr, params.cq_off.ring_mask);
+    ring.cqes = reinterpret_cast<io_uring_cqe*>(
+        reinterpret_cast<char*>(ring.cq_ring_ptr) + params.cq_off.cqes);
+    return ring;
+}
+
+IoUring::IoUring(IoUring&& other)
+    : ring_fd(other.ring_fd),
+      sq_ring_ptr(other.sq_ring_ptr),
+      sq_ring_size(other.sq_ring_size),
+      cq_ring_ptr(other.cq_ring_ptr),
+      cq_ring_size(other.cq_ring_size),
+      sqes(other.sqes),
+      sqes_size(other.sqes_size),
+      sq_head(other.sq_head),
+      sq_tail(other.sq_tail),
+      sq_ring_mask(other.sq_ring_mask),
+      sq_array(other.sq_array),
+      cq_head(other.cq_head),
+      cq_tail(other.cq_tail),
+      cq_ring_mask(other.cq_ring_mask),
+      cqes(other.cqes),
+      sq_entries(other.sq_entries),
+      to_submit(other.to_submit) {
+    other.ring_fd = -1;
+    other.sq_ring_ptr = MAP_FAILED;
+    other.cq_ring_ptr = MAP_FAILED;
+    other.sqes = reinterpret_cast<io_uring_sqe*>(MAP_FAILED);
+}
+
+void IoUring::release() {
+    if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+    if (cq_ring_ptr != MAP_FAILED && cq_ring_ptr != sq_ring_ptr) {
+        munmap(cq_ring_ptr, cq_ring_size);
+    }
+    if (sq_ring_ptr != MAP_FAILED) munmap(sq_ring_ptr, sq_ring_size);
+    if (ring_fd >= 0) close(ring_fd);
+}
+
+IoUring::~IoUring() { release(); }
+
+bool IoUring::queue_read(int fd, void* buffer, unsigned length, long offset,
+                         uint64_t user_data) {
+    const unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    const unsigned tail = *sq_tail;
+    if (tail - head >= sq_entries) return false;
+
+    const unsigned index = tail & *sq_ring_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++to_submit;
+    return true;
+}
+
+absl::Status IoUring::submit_and_wait(unsigned wait_nr) {
+    while (true) {
+        const unsigned flags = (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0;
+        int res = io_uring_enter(ring_fd, to_submit, wait_nr, flags);
+        if (res >= 0) {
+            to_submit -= static_cast<unsigned>(res);
+            return absl::OkStatus();
+        }
+        if (errno != EINTR) {
+            return absl::UnknownError(
+                "IoUring::submit_and_wait error: io_uring_enter failed");
+        }
+    }
+}
+
+bool IoUring::pop_completion(uint64_t& user_data, int& result) {
+    const unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) return false;
+
+    const io_uring_cqe* cqe = &cqes[head & *cq_ring_mask];
+    user_data = cqe->user_data;
+    result = cqe->res;
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+unsigned IoUring::get_entries() const { return sq_entries; }
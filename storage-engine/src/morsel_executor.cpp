@@ -0,0 +1,96 @@
+#include <morsel_executor.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+
+MorselExecutor::MorselExecutor(
+    const StorageEngine& storage_engine,
+    std::span<const StorageEngine::BlockId> driving_blocks, size_t morsel_size)
+    : morsel_size(std::max<size_t>(morsel_size, 1)) {
+    const size_t number_of_devices = storage_engine.get_number_of_files();
+    for (size_t i = 0; i < number_of_devices; ++i) {
+        devices.emplace_back(std::make_unique<DeviceMorsels>());
+    }
+    for (size_t position = 0; position < driving_blocks.size(); ++position) {
+        const short file_id =
+            storage_engine.get_block_file_id(driving_blocks[position]);
+        devices[file_id]->positions.emplace_back(position);
+    }
+    for (auto& device : devices) {
+        device->morsel_count =
+            (device->positions.size() + this->morsel_size - 1) /
+            this->morsel_size;
+    }
+}
+
+std::span<const size_t> MorselExecutor::claim(size_t file_id) {
+    DeviceMorsels& device = *devices[file_id];
+    // cheap check first, so that drained devices aren't hammered by thieves
+    if (device.next.load(std::memory_order_relaxed) >= device.morsel_count) {
+        return {};
+    }
+    const size_t morsel = device.next.fetch_add(1, std::memory_order_relaxed);
+    if (morsel >= device.morsel_count) return {};
+    const size_t begin = morsel * morsel_size;
+    const size_t end = std::min(begin + morsel_size, device.positions.size());
+    return std::span<const size_t>(device.positions.data() + begin,
+                                   end - begin);
+}
+
+absl::Status MorselExecutor::run(size_t thread_number, const Task& task) {
+    if (thread_number == 0) thread_number = 1;
+    for (auto& device : devices) device->next = 0;
+    stolen_count = 0;
+
+    std::atomic<bool> failed = false;
+    std::mutex status_mutex;
+    absl::Status status = absl::OkStatus();
+
+    auto worker_loop = [&](size_t worker) {
+        const size_t number_of_devices = devices.size();
+        const size_t home = worker % number_of_devices;
+        for (size_t i = 0; i < number_of_devices && !failed; ++i) {
+            const size_t file_id = (home + i) % number_of_devices;
+            for (auto positions = claim(file_id);
+                 !positions.empty() && !failed; positions = claim(file_id)) {
+                if (file_id != home) {
+                    stolen_count.fetch_add(1, std::memory_order_relaxed);
+                }
+                auto res = task(worker, positions);
+                if (!res.ok()) {
+                    std::lock_guard lock(status_mutex);
+                    if (status.ok()) status = res;
+                    failed = true;
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t worker = 1; worker < thread_number; ++worker) {
+        threads.emplace_back(worker_loop, worker);
+    }
+    worker_loop(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return status;
+}
+
+size_t MorselExecutor::get_morsel_count() const {
+    size_t morsel_count = 0;
+    for (auto& device : devices) morsel_count += device->morsel_count;
+    return morsel_count;
+}
+
+size_t MorselExecutor::get_stolen_count() const {
+    return stolen_count.load(std::memory_order_relaxed);
+}
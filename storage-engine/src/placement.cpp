@@ -0,0 +1,121 @@
+#include <placement.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+std::vector<short> lpt_placement(const std::vector<double>& heat,
+                                 const DeviceTopology& topology) {
+    const size_t number_of_devices = topology.size();
+    std::vector<size_t> order(heat.size());
+    std::iota(order.begin(), order.end(), 0);
+    // ties keep id order, so equally hot blocks end up round robin
+    std::stable_sort(order.begin(), order.end(),
+                     [&heat](size_t lhs, size_t rhs) {
+                         return heat[lhs] > heat[rhs];
+                     });
+
+    // there are only a handful of devices, so all of them are scanned per
+    // block; equal loads (e.g. cold blocks) are broken by the number of
+    // blocks, so that capacity is spread by weight as well
+    std::vector<double> load(number_of_devices, 0);
+    std::vector<double> blocks(number_of_devices, 0);
+    std::vector<short> placement(heat.size(), 0);
+    for (size_t block_id : order) {
+        size_t best = 0;
+        double best_load = 0;
+        double best_blocks = 0;
+        for (size_t i = 0; i < number_of_devices; ++i) {
+            const double weight = topology.get_device(i).weight;
+            const double new_load = (load[i] + heat[block_id]) / weight;
+            const double new_blocks = (blocks[i] + 1) / weight;
+            if (i == 0 || new_load < best_load ||
+                (new_load == best_load && new_blocks < best_blocks)) {
+                best = i;
+                best_load = new_load;
+                best_blocks = new_blocks;
+            }
+        }
+        load[best] += heat[block_id];
+        blocks[best] += 1;
+        placement[block_id] = static_cast<short>(best);
+    }
+    return placement;
+}
+
+std::vector<double> expected_device_load(const std::vector<double>& heat,
+                                         const std::vector<short>& placement,
+                                         size_t number_of_devices) {
+    std::vector<double> load(number_of_devices, 0);
+    for (size_t block_id = 0; block_id < heat.size(); ++block_id) {
+        load[placement[block_id]] += heat[block_id];
+    }
+    return load;
+}
+
+std::vector<std::pair<size_t, short>> plan_migrations(
+    const std::vector<double>& heat, std::vector<short> placement,
+    const DeviceTopology& topology, std::vector<size_t> block_count_per_file,
+    size_t block_size, size_t max_migrations) {
+    const size_t number_of_devices = topology.size();
+    auto block_heat = [&heat](size_t block_id) {
+        return (block_id < heat.size()) ? heat[block_id] : 0.0;
+    };
+    auto weight = [&topology](size_t file_id) {
+        return topology.get_device(file_id).weight;
+    };
+    auto has_room = [&](size_t file_id) {
+        const size_t capacity = topology.get_device(file_id).capacity;
+        return capacity == 0 ||
+               (block_count_per_file[file_id] + 1) * block_size <= capacity;
+    };
+
+    std::vector<double> load(number_of_devices, 0);
+    for (size_t block_id = 0; block_id < placement.size(); ++block_id) {
+        load[placement[block_id]] += block_heat(block_id);
+    }
+
+    std::vector<std::pair<size_t, short>> migrations;
+    while (migrations.size() < max_migrations) {
+        size_t source = 0;
+        size_t target = number_of_devices;
+        for (size_t i = 0; i < number_of_devices; ++i) {
+            if (load[i] / weight(i) > load[source] / weight(source)) source = i;
+            if (has_room(i) &&
+                (target == number_of_devices ||
+                 load[i] / weight(i) < load[target] / weight(target))) {
+                target = i;
+            }
+        }
+        if (target == number_of_devices || target == source) break;
+
+        const double source_load = load[source] / weight(source);
+        size_t best_block = placement.size();
+        double best_load = source_load;
+        for (size_t block_id = 0; block_id < placement.size(); ++block_id) {
+            const double h = block_heat(block_id);
+            if (placement[block_id] != static_cast<short>(source) || h <= 0) {
+                continue;
+            }
+            const double new_load =
+                std::max((load[source] - h) / weight(source),
+                         (load[target] + h) / weight(target));
+            if (new_load < best_load) {
+                best_block = block_id;
+                best_load = new_load;
+            }
+        }
+        if (best_block == placement.size()) break;
+
+        const double h = block_heat(best_block);
+        load[source] -= h;
+        load[target] += h;
+        block_count_per_file[source] -= 1;
+        block_count_per_file[target] += 1;
+        placement[best_block] = static_cast<short>(target);
+        migrations.emplace_back(best_block, static_cast<short>(target));
+    }
+    return migrations;
+}
@@ -0,0 +1,208 @@
+#include <fcntl.h>
+#include <placement_map.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace {
+
+// device ids of placement as they are stored, checked against
+// number_of_devices
+absl::StatusOr<std::vector<uint16_t>> to_device_ids(
+    const std::vector<short>& placement, size_t number_of_devices) {
+    std::vector<uint16_t> devices(placement.size());
+    for (size_t i = 0; i < placement.size(); ++i) {
+        if (placement[i] < 0 ||
+            static_cast<size_t>(placement[i]) >= number_of_devices) {
+            return absl::InvalidArgumentError("device id out of range");
+        }
+        devices[i] = placement[i];
+    }
+    return devices;
+}
+
+absl::Status write_placement_map(const std::filesystem::path& path,
+                                 const std::vector<short>& column_offsets,
+                                 const std::vector<short>& placement,
+                                 size_t number_of_devices) {
+    if (number_of_devices == 0 ||
+        number_of_devices > std::numeric_limits<uint16_t>::max()) {
+        return absl::InvalidArgumentError("invalid number of devices");
+    }
+    auto offsets_res = to_device_ids(column_offsets, number_of_devices);
+    if (!offsets_res.ok()) return offsets_res.status();
+    auto devices_res = to_device_ids(placement, number_of_devices);
+    if (!devices_res.ok()) return devices_res.status();
+
+    // written aside and renamed, so that a reader never sees half a map
+    std::filesystem::path tmp_path = path;
+    tmp_path += ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (out.fail()) return absl::UnavailableError("ofstream open failed");
+    const PlacementMapHeader header = {
+        kPlacementMapMagic, kPlacementMapVersion,
+        static_cast<uint32_t>(number_of_devices),
+        static_cast<uint32_t>(column_offsets.size()), placement.size()};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(offsets_res->data()),
+              offsets_res->size() * sizeof(uint16_t));
+    out.write(reinterpret_cast<const char*>(devices_res->data()),
+              devices_res->size() * sizeof(uint16_t));
+    out.close();
+    if (out.fail()) return absl::UnknownError("writing failed");
+    std::error_code error;
+    std::filesystem::rename(tmp_path, path, error);
+    if (error) return absl::UnknownError("rename failed");
+    return absl::OkStatus();
+}
+
+}  // namespace
+
+PlacementMap::PlacementMap(void* map, size_t map_size)
+    : map(map),
+      map_size(map_size),
+      header(static_cast<const PlacementMapHeader*>(map)),
+      column_offsets(reinterpret_cast<const uint16_t*>(header + 1)) {}
+
+PlacementMap::~PlacementMap() { munmap(map, map_size); }
+
+absl::StatusOr<std::shared_ptr<const PlacementMap>> PlacementMap::open(
+    const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return absl::NotFoundError(
+            "PlacementMap::open error: opening placement map failed");
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return absl::UnavailableError("PlacementMap::open error: fstat failed");
+    }
+    const size_t file_size = file_stat.st_size;
+    if (file_size < sizeof(PlacementMapHeader)) {
+        close(fd);
+        return absl::DataLossError(
+            "PlacementMap::open error: not a placement map");
+    }
+    void* map = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps the file referenced
+    close(fd);
+    if (map == MAP_FAILED) {
+        return absl::UnavailableError("PlacementMap::open error: mmap failed");
+    }
+    std::unique_ptr<PlacementMap> placement_map(new PlacementMap(map, file_size));
+
+    const PlacementMapHeader& header = *placement_map->header;
+    if (header.magic != kPlacementMapMagic ||
+        header.version != kPlacementMapVersion) {
+        return absl::DataLossError(
+            "PlacementMap::open error: not a placement map");
+    }
+    // the counts are bounded by the file before they are added up, so that
+    // a corrupt header can't overflow the size
+    const size_t id_capacity = (file_size - sizeof(header)) / sizeof(uint16_t);
+    if (header.number_of_devices == 0 || header.column_count > id_capacity ||
+        header.entry_count > id_capacity - header.column_count ||
+        file_size != sizeof(header) + (header.column_count +
+                                       header.entry_count) * sizeof(uint16_t)) {
+        return absl::DataLossError(
+            "PlacementMap::open error: size doesn't match the header");
+    }
+    placement_map->devices =
+        placement_map->column_offsets + header.column_count;
+    // one pass here keeps device() a plain load
+    const size_t number_of_devices = header.number_of_devices;
+    const uint16_t* ids = placement_map->column_offsets;
+    const size_t id_count = header.column_count + header.entry_count;
+    if (std::any_of(ids, ids + id_count, [number_of_devices](uint16_t id) {
+            return id >= number_of_devices;
+        })) {
+        return absl::DataLossError(
+            "PlacementMap::open error: device id out of range");
+    }
+    return std::shared_ptr<const PlacementMap>(std::move(placement_map));
+}
+
+absl::Status save_placement_map(const std::filesystem::path& path,
+                                const std::vector<short>& placement,
+                                size_t number_of_devices) {
+    auto res = write_placement_map(path, {}, placement, number_of_devices);
+    if (!res.ok()) {
+        return absl::Status(res.code(),
+                            "save_placement_map error: " +
+                                std::string(res.message()));
+    }
+    return absl::OkStatus();
+}
+
+absl::Status save_row_group_placement_map(
+    const std::filesystem::path& path,
+    const std::vector<short>& row_group_placement,
+    const std::vector<short>& column_offsets, size_t number_of_devices) {
+    if (column_offsets.empty()) {
+        return absl::InvalidArgumentError(
+            "save_row_group_placement_map error: no column offsets");
+    }
+    auto res = write_placement_map(path, column_offsets, row_group_placement,
+                                   number_of_devices);
+    if (!res.ok()) {
+        return absl::Status(res.code(),
+                            "save_row_group_placement_map error: " +
+                                std::string(res.message()));
+    }
+    return absl::OkStatus();
+}
+
+absl::StatusOr<std::vector<short>> load_placement_map(
+    const std::filesystem::path& path) {
+    auto map_res = PlacementMap::open(path);
+    if (!map_res.ok()) return map_res.status();
+    const PlacementMap& placement_map = **map_res;
+    if (placement_map.is_row_group_map()) {
+        return absl::InvalidArgumentError(
+            "load_placement_map error: map is per row group");
+    }
+    std::vector<short> placement(placement_map.size());
+    for (size_t block_id = 0; block_id < placement.size(); ++block_id) {
+        placement[block_id] = static_cast<short>(placement_map.device(block_id));
+    }
+    return placement;
+}
+
+absl::StatusOr<std::vector<short>> load_text_placement_map(
+    const std::filesystem::path& path) {
+    std::ifstream in(path);
+    if (in.fail()) {
+        return absl::NotFoundError(
+            "load_text_placement_map error: ifstream open failed");
+    }
+    std::vector<short> placement;
+    long device;
+    while (in >> device) {
+        if (device < 0 || device > std::numeric_limits<short>::max()) {
+            return absl::DataLossError(
+                "load_text_placement_map error: device id out of range");
+        }
+        placement.emplace_back(static_cast<short>(device));
+    }
+    if (!in.eof()) {
+        return absl::DataLossError(
+            "load_text_placement_map error: not a device id");
+    }
+    return placement;
+}
@@ -0,0 +1,359 @@
+#include <placement.h>
+#include <placement_optimizer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace {
+
+uint64_t mix(uint64_t x) {
+    // splitmix64 finalizer
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+}  // namespace
+
+PlacementOptimizer::PlacementOptimizer(const std::vector<double>& heat,
+                                       const DeviceTopology& topology,
+                                       size_t block_size)
+    : heat(heat) {
+    for (const auto& device : topology.get_devices()) {
+        weight.emplace_back(device.weight);
+        capacity.emplace_back((device.capacity == 0 || block_size == 0)
+                                  ? static_cast<size_t>(-1)
+                                  : device.capacity / block_size);
+    }
+}
+
+absl::StatusOr<PlacementOptimizer> PlacementOptimizer::create(
+    const std::vector<double>& heat, const std::vector<CoAccess>& co_accesses,
+    const DeviceTopology& topology, size_t block_size) {
+    if (topology.size() > static_cast<size_t>(std::numeric_limits<short>::max())) {
+        return absl::InvalidArgumentError(
+            "PlacementOptimizer::create error: too many devices");
+    }
+    for (double h : heat) {
+        if (!(h >= 0) || std::isinf(h)) {
+            return absl::InvalidArgumentError(
+                "PlacementOptimizer::create error: heat must be finite and "
+                "nonnegative");
+        }
+    }
+    const size_t block_count = heat.size();
+    for (const CoAccess& co_access : co_accesses) {
+        if (co_access.first >= block_count || co_access.second >= block_count ||
+            co_access.first == co_access.second) {
+            return absl::InvalidArgumentError(
+                "PlacementOptimizer::create error: co-access of an unknown "
+                "block or of a block with itself");
+        }
+        if (!(co_access.weight >= 0) || std::isinf(co_access.weight)) {
+            return absl::InvalidArgumentError(
+                "PlacementOptimizer::create error: co-access weight must be "
+                "finite and nonnegative");
+        }
+    }
+
+    PlacementOptimizer optimizer(heat, topology, block_size);
+    size_t total_capacity = 0;
+    for (size_t device_capacity : optimizer.capacity) {
+        total_capacity = std::min(total_capacity + device_capacity,
+                                  static_cast<size_t>(-1) / 2);
+    }
+    if (total_capacity < block_count) {
+        return absl::ResourceExhaustedError(
+            "PlacementOptimizer::create error: blocks don't fit on the "
+            "devices");
+    }
+
+    // both directions of every co-access, grouped by block
+    optimizer.neighbor_offsets.assign(block_count + 1, 0);
+    for (const CoAccess& co_access : co_accesses) {
+        optimizer.neighbor_offsets[co_access.first + 1] += 1;
+        optimizer.neighbor_offsets[co_access.second + 1] += 1;
+    }
+    for (size_t i = 0; i < block_count; ++i) {
+        optimizer.neighbor_offsets[i + 1] += optimizer.neighbor_offsets[i];
+    }
+    optimizer.neighbors.resize(optimizer.neighbor_offsets[block_count]);
+    optimizer.neighbor_weights.resize(optimizer.neighbor_offsets[block_count]);
+    std::vector<size_t> next(optimizer.neighbor_offsets.begin(),
+                             optimizer.neighbor_offsets.end() - 1);
+    for (const CoAccess& co_access : co_accesses) {
+        optimizer.neighbors[next[co_access.first]] = co_access.second;
+        optimizer.neighbor_weights[next[co_access.first]++] = co_access.weight;
+        optimizer.neighbors[next[co_access.second]] = co_access.first;
+        optimizer.neighbor_weights[next[co_access.second]++] = co_access.weight;
+    }
+
+    auto res = optimizer.set_placement(lpt_placement(heat, topology));
+    if (!res.ok()) return res;
+    return optimizer;
+}
+
+absl::Status PlacementOptimizer::set_placement(
+    const std::vector<short>& initial) {
+    const size_t number_of_devices = weight.size();
+    if (initial.size() != heat.size()) {
+        return absl::InvalidArgumentError(
+            "PlacementOptimizer::set_placement error: placement doesn't "
+            "cover every block");
+    }
+    for (short device : initial) {
+        if (device < 0 || static_cast<size_t>(device) >= number_of_devices) {
+            return absl::InvalidArgumentError(
+                "PlacementOptimizer::set_placement error: device id out of "
+                "range");
+        }
+    }
+
+    placement = initial;
+    load.assign(number_of_devices, 0);
+    device_blocks.assign(number_of_devices, {});
+    block_position.resize(heat.size());
+    for (size_t block_id = 0; block_id < heat.size(); ++block_id) {
+        const size_t device = placement[block_id];
+        load[device] += heat[block_id];
+        // every co-access is counted from its smaller block
+        for (size_t k = neighbor_offsets[block_id];
+             k < neighbor_offsets[block_id + 1]; ++k) {
+            if (neighbors[k] > block_id &&
+                static_cast<size_t>(placement[neighbors[k]]) == device) {
+                load[device] += neighbor_weights[k];
+            }
+        }
+        block_position[block_id] = device_blocks[device].size();
+        device_blocks[device].emplace_back(block_id);
+    }
+    return absl::OkStatus();
+}
+
+void PlacementOptimizer::neighbor_load(size_t block_id, size_t excluded,
+                                       std::vector<double>& device_load) const {
+    device_load.assign(weight.size(), 0);
+    for (size_t k = neighbor_offsets[block_id];
+         k < neighbor_offsets[block_id + 1]; ++k) {
+        if (neighbors[k] == excluded) continue;
+        device_load[placement[neighbors[k]]] += neighbor_weights[k];
+    }
+}
+
+PlacementOptimizer::Move PlacementOptimizer::best_move(
+    size_t block_id, uint64_t salt, size_t swap_candidates,
+    std::vector<double>& block_load, std::vector<double>& other_load) const {
+    const size_t number_of_devices = weight.size();
+    const size_t block_count = heat.size();
+    const size_t source = placement[block_id];
+
+    double max_load = 0;
+    for (size_t device = 0; device < number_of_devices; ++device) {
+        max_load = std::max(max_load, load[device] / weight[device]);
+    }
+    Move best = {number_of_devices, block_count, max_load, 0};
+
+    // objective with the loads of source and target replaced
+    auto consider = [&](size_t target, size_t swap_block, double source_load,
+                        double target_load) {
+        double new_max = std::max(source_load / weight[source],
+                                  target_load / weight[target]);
+        for (size_t device = 0; device < number_of_devices; ++device) {
+            if (device == source || device == target) continue;
+            new_max = std::max(new_max, load[device] / weight[device]);
+        }
+        const double square_sum_delta =
+            source_load * source_load / weight[source] +
+            target_load * target_load / weight[target] -
+            load[source] * load[source] / weight[source] -
+            load[target] * load[target] / weight[target];
+        // lexicographic on (max, square sum); the square sum has to drop by
+        // more than rounding noise, so that the search can't cycle
+        const double noise =
+            1e-12 * (std::abs(load[source]) + std::abs(load[target]) + 1) *
+            (std::abs(load[source]) + std::abs(load[target]) + 1);
+        if (new_max < best.max_load ||
+            (new_max == best.max_load &&
+             square_sum_delta < best.square_sum_delta - noise)) {
+            best = {target, swap_block, new_max, square_sum_delta};
+        }
+    };
+
+    neighbor_load(block_id, block_count, block_load);
+    for (size_t target = 0; target < number_of_devices; ++target) {
+        if (target == source) continue;
+        if (device_blocks[target].size() < capacity[target]) {
+            consider(target, block_count,
+                     load[source] - heat[block_id] - block_load[source],
+                     load[target] + heat[block_id] + block_load[target]);
+        }
+    }
+
+    // a swap also gets out of balanced placements where no single move
+    // helps, e.g. two co-accessed pairs sharing their devices. Candidates
+    // are random blocks, so each one costs cache misses; they are only taken
+    // from the least loaded other device, and not for a block that adds
+    // nothing to its device.
+    if (heat[block_id] + block_load[source] <= 0) return best;
+    size_t target = number_of_devices;
+    for (size_t device = 0; device < number_of_devices; ++device) {
+        if (device == source) continue;
+        if (target == number_of_devices ||
+            load[device] / weight[device] < load[target] / weight[target]) {
+            target = device;
+        }
+    }
+    if (target == number_of_devices) return best;
+    const std::vector<size_t>& candidates = device_blocks[target];
+    for (size_t k = 0; k < swap_candidates && !candidates.empty(); ++k) {
+        const size_t other = candidates[mix(salt + k) % candidates.size()];
+        // co-access between the two blocks stays split over two devices
+        double pair_weight = 0;
+        for (size_t j = neighbor_offsets[block_id];
+             j < neighbor_offsets[block_id + 1]; ++j) {
+            if (neighbors[j] == other) pair_weight += neighbor_weights[j];
+        }
+        neighbor_load(other, block_id, other_load);
+        consider(target, other,
+                 load[source] - heat[block_id] - block_load[source] +
+                     heat[other] + other_load[source],
+                 load[target] - heat[other] - other_load[target] +
+                     heat[block_id] + block_load[target] - pair_weight);
+    }
+    return best;
+}
+
+void PlacementOptimizer::apply(size_t block_id, const Move& move,
+                               std::vector<double>& block_load,
+                               std::vector<double>& other_load) {
+    const size_t source = placement[block_id];
+    const size_t target = move.target;
+    if (move.swap_block == heat.size()) {
+        neighbor_load(block_id, heat.size(), block_load);
+        load[source] -= heat[block_id] + block_load[source];
+        load[target] += heat[block_id] + block_load[target];
+        set_device(block_id, target);
+        return;
+    }
+    const size_t other = move.swap_block;
+    neighbor_load(block_id, other, block_load);
+    neighbor_load(other, block_id, other_load);
+    load[source] += heat[other] + other_load[source] - heat[block_id] -
+                    block_load[source];
+    load[target] += heat[block_id] + block_load[target] - heat[other] -
+                    other_load[target];
+    set_device(block_id, target);
+    set_device(other, source);
+}
+
+void PlacementOptimizer::set_device(size_t block_id, size_t device) {
+    // swap-remove from the old device
+    std::vector<size_t>& old_blocks = device_blocks[placement[block_id]];
+    const size_t position = block_position[block_id];
+    old_blocks[position] = old_blocks.back();
+    block_position[old_blocks[position]] = position;
+    old_blocks.pop_back();
+
+    block_position[block_id] = device_blocks[device].size();
+    device_blocks[device].emplace_back(block_id);
+    placement[block_id] = static_cast<short>(device);
+}
+
+size_t PlacementOptimizer::optimize(const PlacementOptimizerOptions& options) {
+    const size_t number_of_devices = weight.size();
+    const size_t block_count = heat.size();
+    const size_t thread_number = std::max<size_t>(options.thread_number, 1);
+    const size_t batch_size = std::max<size_t>(options.batch_size, 1);
+    auto salt = [&](size_t round, size_t block_id) {
+        return mix(options.seed ^ mix(round * block_count + block_id));
+    };
+
+    std::vector<double> block_load;
+    std::vector<double> other_load;
+    std::vector<char> candidate;
+    size_t applied = 0;
+    for (size_t round = 0; round < options.max_rounds; ++round) {
+        size_t round_applied = 0;
+        for (size_t first = 0; first < block_count; first += batch_size) {
+            const size_t last = std::min(first + batch_size, block_count);
+            if (thread_number == 1) {
+                for (size_t block_id = first; block_id < last; ++block_id) {
+                    const Move move =
+                        best_move(block_id, salt(round, block_id),
+                                  options.swap_candidates, block_load,
+                                  other_load);
+                    if (move.target == number_of_devices) continue;
+                    apply(block_id, move, block_load, other_load);
+                    round_applied += 1;
+                }
+                continue;
+            }
+
+            // most blocks have no improving move, so the threads only pick
+            // out the ones that have one against the state of the batch start
+            candidate.assign(last - first, 0);
+            std::vector<std::thread> threads;
+            const size_t chunk =
+                (last - first + thread_number - 1) / thread_number;
+            for (size_t t = 0; t < thread_number; ++t) {
+                const size_t chunk_first = std::min(first + t * chunk, last);
+                const size_t chunk_last = std::min(chunk_first + chunk, last);
+                threads.emplace_back([&, round, first, chunk_first,
+                                      chunk_last] {
+                    std::vector<double> thread_block_load;
+                    std::vector<double> thread_other_load;
+                    for (size_t block_id = chunk_first; block_id < chunk_last;
+                         ++block_id) {
+                        candidate[block_id - first] =
+                            best_move(block_id, salt(round, block_id),
+                                      options.swap_candidates,
+                                      thread_block_load, thread_other_load)
+                                .target != number_of_devices;
+                    }
+                });
+            }
+            for (auto& thread : threads) thread.join();
+
+            // earlier moves of the batch may have changed the best move or
+            // taken away the gain, so each candidate is evaluated again
+            for (size_t block_id = first; block_id < last; ++block_id) {
+                if (!candidate[block_id - first]) continue;
+                const Move move =
+                    best_move(block_id, salt(round, block_id),
+                              options.swap_candidates, block_load, other_load);
+                if (move.target == number_of_devices) continue;
+                apply(block_id, move, block_load, other_load);
+                round_applied += 1;
+            }
+        }
+        applied += round_applied;
+        if (round_applied == 0) break;
+    }
+    return applied;
+}
+
+const std::vector<short>& PlacementOptimizer::get_placement() const {
+    return placement;
+}
+
+std::vector<double> PlacementOptimizer::get_device_load() const {
+    std::vector<double> device_load(load.size());
+    for (size_t device = 0; device < load.size(); ++device) {
+        device_load[device] = load[device] / weight[device];
+    }
+    return device_load;
+}
+
+double PlacementOptimizer::get_max_load() const {
+    const std::vector<double> device_load = get_device_load();
+    return *std::max_element(device_load.begin(), device_load.end());
+}
@@ -0,0 +1,258 @@
+#include <placement.h>
+#include <placement_simulator.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// every mode but HeatAware and Explicit repeats the devices of a column with a period of
+// at most this many row groups
+constexpr size_t kMaxPlacementPeriod = 1 << 22;
+
+// devices of one period of both columns; an empty period means the
+// placement has to be evaluated per row group
+struct PeriodicPlacement {
+    size_t period = 0;
+    std::vector<uint16_t> devices[2];
+};
+
+PeriodicPlacement periodic_placement(const SimulatedPlacement& placement,
+                                     size_t row_group_count,
+                                     size_t number_of_devices) {
+    const size_t cycle_size = placement.placement_cycle.size();
+    PeriodicPlacement periodic;
+    switch (placement.mode) {
+    case StorageEngine::OneDisk:
+        periodic.period = 1;
+        break;
+    case StorageEngine::BatchedRoundRobin:
+        periodic.period = placement.batch_size * cycle_size;
+        break;
+    case StorageEngine::Shift6:
+        periodic.period = cycle_size * cycle_size;
+        break;
+    case StorageEngine::HeatAware:
+    case StorageEngine::Explicit:
+        return periodic;
+    default:
+        periodic.period = cycle_size;
+        break;
+    }
+    if (periodic.period > kMaxPlacementPeriod) {
+        periodic.period = 0;
+        return periodic;
+    }
+    // device(c, t) only depends on t modulo the period of select
+    for (size_t column = 0; column < 2; ++column) {
+        periodic.devices[column].resize(periodic.period);
+        for (size_t k = 0; k < periodic.period; ++k) {
+            periodic.devices[column][k] = placement.device(
+                column, k, row_group_count, number_of_devices);
+        }
+    }
+    return periodic;
+}
+
+// per device reads of row groups [first, last)
+template <typename Outcome, typename Device>
+void count_reads(size_t first, size_t last, const Outcome& outcome,
+                 const Device& device, size_t number_of_devices,
+                 std::vector<uint64_t>& reads) {
+    reads.assign(number_of_devices, 0);
+    for (size_t t = first; t < last; ++t) {
+        const PositionOutcome position_outcome = outcome(t);
+        if (position_outcome == PositionOutcome::ReadA ||
+            position_outcome == PositionOutcome::ReadAB) {
+            reads[device(0, t)] += 1;
+        }
+        if (position_outcome == PositionOutcome::ReadB ||
+            position_outcome == PositionOutcome::ReadAB) {
+            reads[device(1, t)] += 1;
+        }
+    }
+}
+
+template <typename Outcome>
+void count_reads(size_t first, size_t last, const Outcome& outcome,
+                 const SimulatedPlacement& placement,
+                 const PeriodicPlacement& periodic, size_t row_group_count,
+                 size_t number_of_devices, std::vector<uint64_t>& reads) {
+    if (periodic.period == 0) {
+        count_reads(
+            first, last, outcome,
+            [&](size_t column, size_t t) {
+                return placement.device(column, t, row_group_count,
+                                        number_of_devices);
+            },
+            number_of_devices, reads);
+        return;
+    }
+    // the offset into the period advances with t, without a division per
+    // row group
+    size_t offset = first % periodic.period;
+    size_t offset_t = first;
+    count_reads(
+        first, last, outcome,
+        [&](size_t column, size_t t) {
+            for (; offset_t < t; ++offset_t) {
+                if (++offset == periodic.period) offset = 0;
+            }
+            return periodic.devices[column][offset];
+        },
+        number_of_devices, reads);
+}
+
+template <typename Outcome>
+std::vector<uint64_t> parallel_count_reads(size_t row_group_count,
+                                           const Outcome& outcome,
+                                           const SimulatedPlacement& placement,
+                                           size_t number_of_devices,
+                                           size_t thread_number) {
+    const PeriodicPlacement periodic =
+        periodic_placement(placement, row_group_count, number_of_devices);
+    thread_number = std::max<size_t>(
+        1, std::min(thread_number, row_group_count));
+    std::vector<std::vector<uint64_t>> thread_reads(thread_number);
+    std::vector<std::thread> threads;
+    const size_t chunk = (row_group_count + thread_number - 1) / thread_number;
+    for (size_t i = 0; i < thread_number; ++i) {
+        const size_t first = std::min(i * chunk, row_group_count);
+        const size_t last = std::min(first + chunk, row_group_count);
+        threads.emplace_back([&, i, first, last] {
+            count_reads(first, last, outcome, placement, periodic,
+                        row_group_count, number_of_devices, thread_reads[i]);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    std::vector<uint64_t> reads(number_of_devices, 0);
+    for (const auto& local_reads : thread_reads) {
+        for (size_t device = 0; device < number_of_devices; ++device) {
+            reads[device] += local_reads[device];
+        }
+    }
+    return reads;
+}
+
+}  // namespace
+
+double DeviceModel::read_time(size_t bytes) const {
+    return std::max({bytes / bandwidth, 1 / iops,
+                     latency / std::max<size_t>(queue_depth, 1)});
+}
+
+std::vector<DeviceModel> device_models(const DeviceTopology& topology,
+                                       const DeviceModel& base) {
+    std::vector<DeviceModel> models;
+    for (const auto& device : topology.get_devices()) {
+        DeviceModel model = base;
+        model.bandwidth *= device.weight;
+        model.iops *= device.weight;
+        models.emplace_back(model);
+    }
+    return models;
+}
+
+PositionOutcome zone_map_outcome(const BlockZoneMap& zone_map, int bound) {
+    if (!zone_map.may_have_less_than(bound)) return PositionOutcome::Skip;
+    if (zone_map.all_less_than(bound)) return PositionOutcome::ReadB;
+    return PositionOutcome::ReadAB;
+}
+
+size_t SimulatedPlacement::select(size_t block_id) const {
+    switch (mode) {
+    case StorageEngine::OneDisk:
+        return 0;
+    case StorageEngine::BatchedRoundRobin:
+        return batched_round_robin_device(block_id, placement_cycle,
+                                          batch_size);
+    case StorageEngine::Shift6:
+        return shift6_device(block_id, placement_cycle);
+    case StorageEngine::HeatAware:
+    case StorageEngine::Explicit:
+        if (block_id < block_placement.size()) return block_placement[block_id];
+        return round_robin_device(block_id, placement_cycle);
+    default:
+        return round_robin_device(block_id, placement_cycle);
+    }
+}
+
+size_t SimulatedPlacement::device(size_t column, size_t row_group,
+                                  size_t row_group_count,
+                                  size_t number_of_devices) const {
+    switch (layout) {
+    case Spread:
+        return (select(row_group) + column) % number_of_devices;
+    case Colocate:
+        return select(row_group);
+    default:
+        return select(column * row_group_count + row_group);
+    }
+}
+
+PlacementSimulator::PlacementSimulator(const std::vector<DeviceModel>& devices,
+                                       size_t block_size)
+    : devices(devices), block_size(block_size) {}
+
+SimulationResult PlacementSimulator::simulate(
+    std::span<const PositionOutcome> outcomes,
+    const SimulatedPlacement& placement, size_t thread_number) const {
+    // the span is read directly, without going through a std::function
+    return price_reads(parallel_count_reads(
+        outcomes.size(), [outcomes](size_t t) { return outcomes[t]; },
+        resolve(placement), devices.size(), thread_number));
+}
+
+SimulationResult PlacementSimulator::simulate(
+    size_t row_group_count,
+    const std::function<PositionOutcome(size_t)>& outcome,
+    const SimulatedPlacement& placement, size_t thread_number) const {
+    return price_reads(parallel_count_reads(row_group_count, outcome,
+                                            resolve(placement), devices.size(),
+                                            thread_number));
+}
+
+SimulatedPlacement PlacementSimulator::resolve(
+    const SimulatedPlacement& placement) const {
+    SimulatedPlacement resolved = placement;
+    if (resolved.placement_cycle.empty()) {
+        resolved.placement_cycle.resize(devices.size());
+        std::iota(resolved.placement_cycle.begin(),
+                  resolved.placement_cycle.end(), 0);
+    }
+    resolved.batch_size = std::max<size_t>(resolved.batch_size, 1);
+    return resolved;
+}
+
+SimulationResult PlacementSimulator::price_reads(
+    std::vector<uint64_t> reads) const {
+    const size_t number_of_devices = devices.size();
+    SimulationResult result;
+    result.reads = std::move(reads);
+    result.busy_time.resize(number_of_devices);
+    for (size_t device = 0; device < number_of_devices; ++device) {
+        result.busy_time[device] =
+            result.reads[device] * devices[device].read_time(block_size);
+        result.makespan = std::max(result.makespan, result.busy_time[device]);
+    }
+    result.utilization.resize(number_of_devices, 0);
+    if (result.makespan > 0) {
+        for (size_t device = 0; device < number_of_devices; ++device) {
+            result.utilization[device] =
+                result.busy_time[device] / result.makespan;
+        }
+    }
+    return result;
+}
+
+size_t PlacementSimulator::get_number_of_devices() const {
+    return devices.size();
+}
@@ -0,0 +1,314 @@
+#include <predicate.h>
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define PREDICATE_X86 1
+#endif
+
+namespace {
+
+template <typename T>
+size_t scalar_less_than_bitmap(std::span<const T> values, T bound,
+                               std::span<uint64_t> bitmap, size_t first) {
+    size_t passed = 0;
+    for (size_t i = first; i < values.size(); ++i) {
+        const uint64_t bit = uint64_t(1) << (i % 64);
+        if (i % 64 == 0) bitmap[i / 64] = 0;
+        if (values[i] < bound) {
+            bitmap[i / 64] |= bit;
+            ++passed;
+        }
+    }
+    return passed;
+}
+
+template <typename T>
+bool scalar_any_less_than(std::span<const T> values, T bound, size_t first) {
+    for (size_t i = first; i < values.size(); ++i) {
+        if (values[i] < bound) return true;
+    }
+    return false;
+}
+
+template <typename Sum, typename T>
+Sum scalar_masked_sum(std::span<const T> values,
+                      std::span<const uint64_t> bitmap, size_t first) {
+    Sum sum = 0;
+    for (size_t w = first / 64; w < bitmap_word_count(values.size()); ++w) {
+        // walk the set bits only, sparse masks are common
+        for (uint64_t word = bitmap[w]; word != 0; word &= word - 1) {
+            sum += values[w * 64 + std::countr_zero(word)];
+        }
+    }
+    return sum;
+}
+
+#ifdef PREDICATE_X86
+
+// 8 lanes of the comparison as the low byte
+__attribute__((target("avx2"))) inline uint32_t avx2_less_than_mask(
+    const int* values, __m256i bound) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(bound, v)));
+}
+
+__attribute__((target("avx2"))) inline uint32_t avx2_less_than_mask(
+    const float* values, __m256 bound) {
+    return _mm256_movemask_ps(
+        _mm256_cmp_ps(_mm256_loadu_ps(values), bound, _CMP_LT_OQ));
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_broadcast(int bound) {
+    return _mm256_set1_epi32(bound);
+}
+
+__attribute__((target("avx2"))) inline __m256 avx2_broadcast(float bound) {
+    return _mm256_set1_ps(bound);
+}
+
+template <typename T>
+__attribute__((target("avx2"))) size_t avx2_less_than_bitmap(
+    std::span<const T> values, T bound, std::span<uint64_t> bitmap) {
+    const auto bound_vector = avx2_broadcast(bound);
+    const size_t full_words = values.size() / 64;
+    size_t passed = 0;
+    for (size_t w = 0; w < full_words; ++w) {
+        const T* word_values = values.data() + w * 64;
+        uint64_t word = 0;
+        for (size_t j = 0; j < 8; ++j) {
+            word |= uint64_t(avx2_less_than_mask(word_values + 8 * j,
+                                                 bound_vector))
+                    << (8 * j);
+        }
+        bitmap[w] = word;
+        passed += std::popcount(word);
+    }
+    return passed +
+           scalar_less_than_bitmap(values, bound, bitmap, full_words * 64);
+}
+
+template <typename T>
+__attribute__((target("avx2"))) bool avx2_any_less_than(
+    std::span<const T> values, T bound) {
+    const auto bound_vector = avx2_broadcast(bound);
+    // four vectors per check keep the loop from being branch-bound
+    const size_t full_steps = values.size() / 32;
+    for (size_t s = 0; s < full_steps; ++s) {
+        const T* step_values = values.data() + s * 32;
+        uint32_t mask = 0;
+        for (size_t j = 0; j < 4; ++j) {
+            mask |= avx2_less_than_mask(step_values + 8 * j, bound_vector);
+        }
+        if (mask != 0) return true;
+    }
+    return scalar_any_less_than(values, bound, full_steps * 32);
+}
+
+__attribute__((target("avx512f"))) inline uint32_t avx512_less_than_mask(
+    const int* values, __m512i bound) {
+    return _mm512_cmplt_epi32_mask(_mm512_loadu_si512(values), bound);
+}
+
+__attribute__((target("avx512f"))) inline uint32_t avx512_less_than_mask(
+    const float* values, __m512 bound) {
+    return _mm512_cmp_ps_mask(_mm512_loadu_ps(values), bound, _CMP_LT_OQ);
+}
+
+__attribute__((target("avx512f"))) inline __m512i avx512_broadcast(int bound) {
+    return _mm512_set1_epi32(bound);
+}
+
+__attribute__((target("avx512f"))) inline __m512 avx512_broadcast(
+    float bound) {
+    return _mm512_set1_ps(bound);
+}
+
+template <typename T>
+__attribute__((target("avx512f"))) size_t avx512_less_than_bitmap(
+    std::span<const T> values, T bound, std::span<uint64_t> bitmap) {
+    const auto bound_vector = avx512_broadcast(bound);
+    const size_t full_words = values.size() / 64;
+    size_t passed = 0;
+    for (size_t w = 0; w < full_words; ++w) {
+        const T* word_values = values.data() + w * 64;
+        uint64_t word = 0;
+        for (size_t j = 0; j < 4; ++j) {
+            word |= uint64_t(avx512_less_than_mask(word_values + 16 * j,
+                                                   bound_vector))
+                    << (16 * j);
+        }
+        bitmap[w] = word;
+        passed += std::popcount(word);
+    }
+    return passed +
+           scalar_less_than_bitmap(values, bound, bitmap, full_words * 64);
+}
+
+template <typename T>
+__attribute__((target("avx512f"))) bool avx512_any_less_than(
+    std::span<const T> values, T bound) {
+    const auto bound_vector = avx512_broadcast(bound);
+    const size_t full_steps = values.size() / 64;
+    for (size_t s = 0; s < full_steps; ++s) {
+        const T* step_values = values.data() + s * 64;
+        uint32_t mask = 0;
+        for (size_t j = 0; j < 4; ++j) {
+            mask |= avx512_less_than_mask(step_values + 16 * j, bound_vector);
+        }
+        if (mask != 0) return true;
+    }
+    return scalar_any_less_than(values, bound, full_steps * 64);
+}
+
+__attribute__((target("avx2"))) int64_t avx2_masked_sum(
+    std::span<const int> values, std::span<const uint64_t> bitmap) {
+    // lane i of a group of 4 is taken iff bit i of the group's nibble is set
+    const __m256i lane_bits = _mm256_setr_epi64x(1, 2, 4, 8);
+    __m256i sum = _mm256_setzero_si256();
+    const size_t full_words = values.size() / 64;
+    for (size_t w = 0; w < full_words; ++w) {
+        const uint64_t word = bitmap[w];
+        if (word == 0) continue;
+        for (size_t j = 0; j < 16; ++j) {
+            const __m256i nibble = _mm256_set1_epi64x((word >> (4 * j)) & 0xf);
+            const __m256i lane_mask = _mm256_cmpeq_epi64(
+                _mm256_and_si256(nibble, lane_bits), lane_bits);
+            const __m256i wide = _mm256_cvtepi32_epi64(_mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(values.data() + w * 64 + 4 * j)));
+            sum = _mm256_add_epi64(sum, _mm256_and_si256(wide, lane_mask));
+        }
+    }
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sum);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+           scalar_masked_sum<int64_t>(values, bitmap, full_words * 64);
+}
+
+__attribute__((target("avx512f"))) int64_t avx512_masked_sum(
+    std::span<const int> values, std::span<const uint64_t> bitmap) {
+    __m512i sum = _mm512_setzero_si512();
+    const size_t full_words = values.size() / 64;
+    for (size_t w = 0; w < full_words; ++w) {
+        const uint64_t word = bitmap[w];
+        if (word == 0) continue;
+        for (size_t j = 0; j < 8; ++j) {
+            const __m512i wide = _mm512_cvtepi32_epi64(_mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(values.data() + w * 64 + 8 * j)));
+            sum = _mm512_mask_add_epi64(sum, __mmask8(word >> (8 * j)), sum,
+                                        wide);
+        }
+    }
+    return _mm512_reduce_add_epi64(sum) +
+           scalar_masked_sum<int64_t>(values, bitmap, full_words * 64);
+}
+
+#endif  // PREDICATE_X86
+
+}  // namespace
+
+bool is_supported(PredicateKernel kernel) {
+    switch (kernel) {
+    case PredicateKernel::Scalar:
+        return true;
+#ifdef PREDICATE_X86
+    case PredicateKernel::Avx2:
+        return __builtin_cpu_supports("avx2");
+    case PredicateKernel::Avx512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+PredicateKernel best_predicate_kernel() {
+    static const PredicateKernel best = [] {
+        if (is_supported(PredicateKernel::Avx512)) return PredicateKernel::Avx512;
+        if (is_supported(PredicateKernel::Avx2)) return PredicateKernel::Avx2;
+        return PredicateKernel::Scalar;
+    }();
+    return best;
+}
+
+template <typename T>
+size_t less_than_bitmap(std::span<const T> values, T bound,
+                        std::span<uint64_t> bitmap, PredicateKernel kernel) {
+    // 64-bit values have no vector kernel
+    if constexpr (sizeof(T) == 8) {
+        return scalar_less_than_bitmap(values, bound, bitmap, 0);
+    } else {
+        switch (kernel) {
+#ifdef PREDICATE_X86
+        case PredicateKernel::Avx512:
+            return avx512_less_than_bitmap(values, bound, bitmap);
+        case PredicateKernel::Avx2:
+            return avx2_less_than_bitmap(values, bound, bitmap);
+#endif
+        default:
+            return scalar_less_than_bitmap(values, bound, bitmap, 0);
+        }
+    }
+}
+
+template <typename T>
+bool any_less_than(std::span<const T> values, T bound,
+                   PredicateKernel kernel) {
+    if constexpr (sizeof(T) == 8) {
+        return scalar_any_less_than(values, bound, 0);
+    } else {
+        switch (kernel) {
+#ifdef PREDICATE_X86
+        case PredicateKernel::Avx512:
+            return avx512_any_less_than(values, bound);
+        case PredicateKernel::Avx2:
+            return avx2_any_less_than(values, bound);
+#endif
+        default:
+            return scalar_any_less_than(values, bound, 0);
+        }
+    }
+}
+
+template size_t less_than_bitmap<int>(std::span<const int>, int,
+                                      std::span<uint64_t>, PredicateKernel);
+template size_t less_than_bitmap<float>(std::span<const float>, float,
+                                        std::span<uint64_t>, PredicateKernel);
+template size_t less_than_bitmap<int64_t>(std::span<const int64_t>, int64_t,
+                                          std::span<uint64_t>, PredicateKernel);
+template bool any_less_than<int>(std::span<const int>, int, PredicateKernel);
+template bool any_less_than<float>(std::span<const float>, float,
+                                   PredicateKernel);
+template bool any_less_than<int64_t>(std::span<const int64_t>, int64_t,
+                                     PredicateKernel);
+
+int64_t masked_sum(std::span<const int> values,
+                   std::span<const uint64_t> bitmap, PredicateKernel kernel) {
+    switch (kernel) {
+#ifdef PREDICATE_X86
+    case PredicateKernel::Avx512:
+        return avx512_masked_sum(values, bitmap);
+    case PredicateKernel::Avx2:
+        return avx2_masked_sum(values, bitmap);
+#endif
+    default:
+        return scalar_masked_sum<int64_t>(values, bitmap, 0);
+    }
+}
+
+double masked_sum(std::span<const float> values,
+                  std::span<const uint64_t> bitmap,
+                  PredicateKernel /*kernel*/) {
+    // float sums are not on a hot path
+    return scalar_masked_sum<double>(values, bitmap, 0);
+}
+
+int64_t masked_sum(std::span<const int64_t> values,
+                   std::span<const uint64_t> bitmap,
+                   PredicateKernel /*kernel*/) {
+    return scalar_masked_sum<int64_t>(values, bitmap, 0);
+}
@@ -0,0 +1,100 @@
+#include <placement.h>
+#include <rebalancer.h>
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+Rebalancer::Rebalancer(StorageEngine& storage_engine,
+                       size_t migrations_per_round,
+                       std::chrono::milliseconds interval)
+    : storage_engine(storage_engine),
+      migrations_per_round(migrations_per_round),
+      interval(interval) {}
+
+Rebalancer::~Rebalancer() { stop(); }
+
+void Rebalancer::start() {
+    std::lock_guard lock(mutex);
+    if (!stopped) return;
+    stopped = false;
+    worker = std::thread([this] { worker_loop(); });
+}
+
+void Rebalancer::stop() {
+    {
+        std::lock_guard lock(mutex);
+        stopped = true;
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void Rebalancer::worker_loop() {
+    std::unique_lock lock(mutex);
+    while (!stopped) {
+        cv.wait_for(lock, interval, [this] { return stopped; });
+        if (stopped) return;
+        lock.unlock();
+        auto res = rebalance();
+        lock.lock();
+        if (!res.ok()) status = res.status();
+    }
+}
+
+void Rebalancer::set_block_heat(const std::vector<double>& heat) {
+    std::lock_guard lock(mutex);
+    this->heat = heat;
+}
+
+void Rebalancer::set_block_heat(const std::vector<size_t>& access_counts) {
+    set_block_heat(
+        std::vector<double>(access_counts.begin(), access_counts.end()));
+}
+
+absl::StatusOr<size_t> Rebalancer::rebalance() {
+    std::lock_guard round_lock(round_mutex);
+    std::vector<double> round_heat;
+    {
+        std::lock_guard lock(mutex);
+        round_heat = heat;
+    }
+    if (round_heat.empty()) round_heat = storage_engine.get_block_heat();
+
+    // the rebalancer is the only one moving blocks, so the placement can't
+    // change under the plan
+    const size_t block_count = storage_engine.get_block_count();
+    std::vector<short> placement;
+    placement.reserve(block_count);
+    for (size_t block_id = 0; block_id < block_count; ++block_id) {
+        placement.emplace_back(storage_engine.get_block_file_id(block_id));
+    }
+    const auto migrations = plan_migrations(
+        round_heat, std::move(placement), storage_engine.get_topology(),
+        storage_engine.get_metadata().get_block_count_per_file(),
+        storage_engine.get_block_size(), migrations_per_round);
+
+    size_t moved = 0;
+    for (auto [block_id, file_id] : migrations) {
+        auto res = storage_engine.migrate_block(block_id, file_id);
+        if (!res.ok()) return res;
+        ++moved;
+        migrated_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    return moved;
+}
+
+size_t Rebalancer::get_migrated_count() const {
+    return migrated_count.load(std::memory_order_relaxed);
+}
+
+absl::Status Rebalancer::get_status() {
+    std::lock_guard lock(mutex);
+    return status;
+}
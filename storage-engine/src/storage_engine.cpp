@@ -1,5 +1,13 @@
+#include <allocation_journal.h>
+#include <block_encoding.h>
+#include <block_trace.h>
+#include <io_uring.h>
+#include <placement.h>
 #include <storage_engine.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 #include <cassert>
 #include <cstddef>
@@ -7,8 +15,19 @@
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdint>
 #include <ios>
+#include <shared_mutex>
+#include <span>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
@@ -23,6 +42,75 @@ absl::Status create_or_truncate(const std::string& filename) {
     return absl::OkStatus();
 }
 
+bool is_aligned(const void* buffer) {
+    return reinterpret_cast<uintptr_t>(buffer) % 512 == 0;
+}
+
+// pwritev that keeps going after short writes
+absl::Status pwritev_all(int fd, std::vector<iovec>& iovecs, long offset) {
+    size_t first = 0;
+    while (first < iovecs.size()) {
+        const int iovec_count =
+            static_cast<int>(std::min<size_t>(iovecs.size() - first, IOV_MAX));
+        const ssize_t bytes_written =
+            pwritev(fd, iovecs.data() + first, iovec_count, offset);
+        if (bytes_written <= 0) {
+            return absl::UnknownError(
+                "StorageEngine::write_blocks error: pwritev failed");
+        }
+        offset += bytes_written;
+        size_t remaining = bytes_written;
+        while (remaining > 0 && remaining >= iovecs[first].iov_len) {
+            remaining -= iovecs[first].iov_len;
+            ++first;
+        }
+        if (remaining > 0) {
+            iovecs[first].iov_base =
+                reinterpret_cast<char*>(iovecs[first].iov_base) + remaining;
+            iovecs[first].iov_len -= remaining;
+        }
+    }
+    return absl::OkStatus();
+}
+
+uint64_t fnv1a(const void* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// binary StorageMetadata file:
+//   StorageMetadataHeader
+//   DeviceEntry[number_of_files], uint64_t checksum  (the device table)
+//   (uint32_t length, chars) for block_metadata_path and every filename
+// the device table has a fixed offset and size, so block counts are updated
+// in place with a single pwrite
+const uint64_t kStorageMetadataMagic = 0x4154454d42445353;  // "SSDBMETA"
+const uint32_t kStorageMetadataVersion = 1;
+const size_t kDeviceStatCount = 3;  // reserved for per-device statistics
+
+struct StorageMetadataHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t number_of_files;
+    uint64_t file_size;
+    uint64_t names_checksum;
+    uint64_t header_checksum;  // of all the fields above
+};
+
+struct DeviceEntry {
+    uint64_t block_count;
+    uint64_t stats[kDeviceStatCount];
+};
+
+size_t device_table_size(size_t number_of_files) {
+    return number_of_files * sizeof(DeviceEntry) + sizeof(uint64_t);
+}
+
 struct WriteBuffer {
     const size_t block_size;
     char* buffer;
@@ -36,6 +124,43 @@ struct WriteBuffer {
     char* get_buffer() const { return buffer; }
 };
 
+// a block as it goes to its device: the caller's buffer, or its encoding
+// padded to whole sectors if that saves at least one
+struct StoredBlock {
+    const char* buffer;
+    size_t size;
+    BlockEncoding encoding = BlockEncoding::Plain;
+    std::unique_ptr<WriteBuffer> encoded;
+
+    StoredBlock(const char* buffer, size_t block_size, bool compress)
+        : buffer(buffer), size(block_size) {
+        if (!compress || block_size <= kSectorSize) return;
+        encoded = std::make_unique<WriteBuffer>(block_size);
+        const size_t encoded_size = encode_block(
+            std::span<const int>(reinterpret_cast<const int*>(buffer),
+                                 block_size / sizeof(int)),
+            std::span<char>(encoded->get_buffer(), block_size - kSectorSize));
+        if (encoded_size == 0) {
+            encoded.reset();
+            return;
+        }
+        const size_t encoded_sectors_size =
+            (encoded_size + kSectorSize - 1) / kSectorSize * kSectorSize;
+        memset(encoded->get_buffer() + encoded_size, 0,
+               encoded_sectors_size - encoded_size);
+        auto encoding_res = get_block_encoding(std::span<const char>(
+            encoded->get_buffer(), encoded_sectors_size));
+        if (!encoding_res.ok()) {
+            // can't happen for a block encode_block just wrote; stay plain
+            encoded.reset();
+            return;
+        }
+        this->buffer = encoded->get_buffer();
+        size = encoded_sectors_size;
+        encoding = *encoding_res;
+    }
+};
+
 BlockMetadata::BlockMetadata() : file_id(-1), offset(-1) {}
 BlockMetadata::BlockMetadata(short file_id, long offset)
     : file_id(file_id), offset(offset) {}
@@ -52,6 +177,33 @@ absl::Status BlockMetadata::sync(int fd, size_t block_id) const {
         "expected");
 }
 
+BlockZoneMap::BlockZoneMap()
+    : min(0),
+      max(0),
+      valid(0),
+      encoding(BlockEncoding::Plain),
+      stored_sectors(0) {}
+
+BlockZoneMap::BlockZoneMap(std::span<const int> values)
+    : min(INT_MAX),
+      max(INT_MIN),
+      valid(1),
+      encoding(BlockEncoding::Plain),
+      stored_sectors(0) {
+    for (int value : values) {
+        min = std::min(min, value);
+        max = std::max(max, value);
+    }
+}
+
+bool BlockZoneMap::may_have_less_than(int bound) const {
+    return !valid || min < bound;
+}
+
+bool BlockZoneMap::all_less_than(int bound) const {
+    return valid && max < bound;
+}
+
 StorageMetadata::StorageMetadata()
     : block_metadata_path(), filenames(), number_of_files(kNumberOfFiles) {
     filenames.reserve(number_of_files);
@@ -61,29 +213,54 @@ StorageMetadata::StorageMetadata()
 absl::StatusOr<StorageMetadata> StorageMetadata::read_existing_metadata(
     const std::filesystem::path& path) {
     const std::string meta_path = storage_metas_path + path.generic_string();
-    // we only call this from the constructors, so it's fine to use fstream here
+    int fd = open(meta_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return absl::UnavailableError(
+            "StorageMetadata::read_existing_metadata error: open failed");
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return absl::UnavailableError(
+            "StorageMetadata::read_existing_metadata error: fstat failed");
+    }
+    std::string contents(file_stat.st_size, '\0');
+    const size_t bytes_read = pread(fd, contents.data(), contents.size(), 0);
+    close(fd);
+    if (bytes_read != contents.size()) {
+        return absl::UnavailableError(
+            "StorageMetadata::read_existing_metadata error: read failed");
+    }
+
+    if (is_binary_metadata(contents)) return parse_binary_metadata(contents);
+
+    // text file from before the binary format: convert it on first open
+    auto parse_res = parse_text_metadata(contents);
+    if (!parse_res.ok()) return parse_res.status();
+    auto sync_res = parse_res->sync(path);
+    if (!sync_res.ok()) return sync_res;
+    return parse_res;
+}
+
+absl::StatusOr<StorageMetadata> StorageMetadata::parse_text_metadata(
+    const std::string& contents) {
     std::filesystem::path block_metadata_path;
     std::vector<std::string> filenames;
     std::vector<size_t> block_count_per_file;
     size_t number_of_files;
 
-    std::ifstream in;
-    in.open(meta_path);
-    if (in.fail()) {
-        return absl::UnavailableError(
-            "StorageMetada::read_existing_metadata error: ifstream open failed");
-    }
+    std::istringstream in(contents);
 
     in >> number_of_files;
     if (in.fail() || in.bad() || in.eof()) {
         return absl::UnavailableError(
-            "StorageMetadata::read_existing_metadata error: reading from stream "
+            "StorageMetadata::parse_text_metadata error: reading from stream "
             "failed");
     }
     in >> block_metadata_path;
     if (in.fail() || in.bad() || in.eof()) {
         return absl::UnavailableError(
-            "StorageMetadata::read_existing_metadata error: reading from stream "
+            "StorageMetadata::parse_text_metadata error: reading from stream "
             "failed");
     }
 
@@ -94,28 +271,113 @@ absl::StatusOr<StorageMetadata> StorageMetadata::read_existing_metadata(
         in >> filenames[i];
         if (in.fail() || in.bad() || in.eof()) {
             return absl::UnavailableError(
-                "StorageMetadata::read_existing_metadata error: reading from stream "
-                "failed");
+                "StorageMetadata::parse_text_metadata error: reading from "
+                "stream failed");
         }
     }
 
     for (int i = 0; i < number_of_files; ++i) {
         in >> block_count_per_file[i];
-        if (in.fail() || in.bad() || in.eof()) {
+        if (in.fail() || in.bad()) {
             return absl::UnavailableError(
-                "StorageMetadata::read_existing_metadata error: reading from stream "
-                "failed");
+                "StorageMetadata::parse_text_metadata error: reading from "
+                "stream failed");
         }
     }
     return StorageMetadata(block_metadata_path, filenames, block_count_per_file,
                            number_of_files);
 }
 
+bool StorageMetadata::is_binary_metadata(const std::string& contents) {
+    uint64_t magic = 0;
+    if (contents.size() < sizeof(magic)) return false;
+    memcpy(&magic, contents.data(), sizeof(magic));
+    return magic == kStorageMetadataMagic;
+}
+
+absl::StatusOr<StorageMetadata> StorageMetadata::parse_binary_metadata(
+    const std::string& contents) {
+    StorageMetadataHeader header;
+    if (contents.size() < sizeof(header)) {
+        return absl::DataLossError(
+            "StorageMetadata::parse_binary_metadata error: truncated header");
+    }
+    memcpy(&header, contents.data(), sizeof(header));
+    if (header.header_checksum !=
+        fnv1a(&header, offsetof(StorageMetadataHeader, header_checksum))) {
+        return absl::DataLossError(
+            "StorageMetadata::parse_binary_metadata error: header checksum "
+            "mismatch");
+    }
+    if (header.version != kStorageMetadataVersion) {
+        return absl::UnimplementedError(
+            "StorageMetadata::parse_binary_metadata error: unknown version");
+    }
+    if (header.file_size != contents.size()) {
+        return absl::DataLossError(
+            "StorageMetadata::parse_binary_metadata error: unexpected file "
+            "size");
+    }
+
+    const size_t number_of_files = header.number_of_files;
+    const size_t table_offset = sizeof(StorageMetadataHeader);
+    const size_t table_size = device_table_size(number_of_files);
+    if (table_offset + table_size > contents.size()) {
+        return absl::DataLossError(
+            "StorageMetadata::parse_binary_metadata error: truncated device "
+            "table");
+    }
+    const char* table = contents.data() + table_offset;
+    uint64_t table_checksum;
+    memcpy(&table_checksum, table + table_size - sizeof(table_checksum),
+           sizeof(table_checksum));
+    if (table_checksum != fnv1a(table, table_size - sizeof(table_checksum))) {
+        return absl::DataLossError(
+            "StorageMetadata::parse_binary_metadata error: device table "
+            "checksum mismatch");
+    }
+    std::vector<size_t> block_count_per_file(number_of_files);
+    for (size_t i = 0; i < number_of_files; ++i) {
+        DeviceEntry entry;
+        memcpy(&entry, table + i * sizeof(DeviceEntry), sizeof(entry));
+        block_count_per_file[i] = entry.block_count;
+    }
+
+    const size_t names_offset = table_offset + table_size;
+    const char* names = contents.data() + names_offset;
+    const size_t names_size = contents.size() - names_offset;
+    if (header.names_checksum != fnv1a(names, names_size)) {
+        return absl::DataLossError(
+            "StorageMetadata::parse_binary_metadata error: names checksum "
+            "mismatch");
+    }
+    std::vector<std::string> strings;
+    size_t position = 0;
+    for (size_t i = 0; i < number_of_files + 1; ++i) {
+        uint32_t length;
+        if (position + sizeof(length) > names_size) break;
+        memcpy(&length, names + position, sizeof(length));
+        position += sizeof(length);
+        if (position + length > names_size) break;
+        strings.emplace_back(names + position, length);
+        position += length;
+    }
+    if (strings.size() != number_of_files + 1) {
+        return absl::DataLossError(
+            "StorageMetadata::parse_binary_metadata error: truncated names");
+    }
+
+    std::filesystem::path block_metadata_path = strings[0];
+    std::vector<std::string> filenames(strings.begin() + 1, strings.end());
+    return StorageMetadata(block_metadata_path, filenames, block_count_per_file,
+                           number_of_files);
+}
+
 absl::StatusOr<StorageMetadata> StorageMetadata::create_new_storage(
-    const std::filesystem::path& path) {
+    const std::filesystem::path& path, const DeviceTopology& topology) {
     std::filesystem::path block_metadata_path =
         storage_metas_path + path.generic_string() + "_block_metadata";
-    size_t number_of_files = kNumberOfFiles;
+    size_t number_of_files = topology.size();
     std::vector<std::string> filenames(number_of_files, "");
     std::vector<size_t> block_count_per_file(number_of_files, 0);
 
@@ -123,8 +385,13 @@ absl::StatusOr<StorageMetadata> StorageMetadata::create_new_storage(
     if (!res.ok()) {
         return res;
     }
+    // a journal or zone maps left from a previous storage under this path
+    // are stale
+    std::filesystem::remove(AllocationJournal::get_journal_path(path));
+    std::filesystem::remove(StorageEngine::get_zone_map_path(path));
+    std::filesystem::remove(StorageEngine::get_columns_path(path));
 
-    res = create_files(path, filenames);
+    res = create_files(path, topology, filenames);
     if (!res.ok()) {
         return res;
     }
@@ -147,16 +414,76 @@ StorageMetadata::StorageMetadata(
       number_of_files(number_of_files) {}
 
 absl::StatusOr<StorageMetadata> StorageMetadata::create(
-    const std::filesystem::path& path) {
-    return (std::filesystem::exists(storage_metas_path + path.generic_string())) ? read_existing_metadata(path)
-                                           : create_new_storage(path);
+    const std::filesystem::path& path, const DeviceTopology& topology) {
+    if (!std::filesystem::exists(storage_metas_path + path.generic_string())) {
+        return create_new_storage(path, topology);
+    }
+    auto read_res = read_existing_metadata(path);
+    if (!read_res.ok()) return read_res;
+    if (read_res->number_of_files != topology.size()) {
+        return absl::InvalidArgumentError(
+            "StorageMetadata::create error: number of devices doesn't match "
+            "the existing storage");
+    }
+    auto replay_res = replay_journal(path, *read_res);
+    if (!replay_res.ok()) return replay_res;
+    return read_res;
+}
+
+absl::Status StorageMetadata::replay_journal(const std::filesystem::path& path,
+                                             StorageMetadata& metadata) {
+    auto records_res = AllocationJournal::read_records(path);
+    if (!records_res.ok()) return records_res.status();
+    if (records_res->empty()) return absl::OkStatus();
+
+    // blocks are allocated in id order, so records below the checkpointed
+    // block count are already applied (crash between checkpoint and
+    // truncation) and replay stops at the first gap
+    const size_t first_id = metadata.block_count();
+    std::vector<BlockMetadata> replayed;
+    for (const auto& record : *records_res) {
+        if (record.block_id < first_id + replayed.size()) continue;
+        if (record.block_id != first_id + replayed.size() ||
+            record.file_id >= metadata.number_of_files) {
+            break;
+        }
+        replayed.emplace_back(record.file_id, record.offset);
+    }
+
+    if (!replayed.empty()) {
+        int fd = open(metadata.block_metadata_path.c_str(), O_WRONLY);
+        if (fd < 0) {
+            return absl::UnavailableError(
+                "StorageMetadata::replay_journal error: opening block metadata "
+                "file failed");
+        }
+        const size_t bytes = replayed.size() * sizeof(BlockMetadata);
+        const size_t bytes_written = pwrite(fd, replayed.data(), bytes,
+                                            first_id * sizeof(BlockMetadata));
+        const bool synced = (fdatasync(fd) == 0);
+        close(fd);
+        if (bytes_written != bytes || !synced) {
+            return absl::UnknownError(
+                "StorageMetadata::replay_journal error: writing block metadata "
+                "failed");
+        }
+        for (const auto& block_metadata : replayed) {
+            metadata.block_count_per_file[block_metadata.file_id] += 1;
+        }
+        auto sync_res = metadata.sync(path);
+        if (!sync_res.ok()) return sync_res;
+    }
+    std::filesystem::resize_file(AllocationJournal::get_journal_path(path), 0);
+    return absl::OkStatus();
 }
 
-absl::Status StorageMetadata::create_files(
-    const std::filesystem::path& path, std::vector<std::string>& filenames) {
+absl::Status StorageMetadata::create_files(const std::filesystem::path& path,
+                                          const DeviceTopology& topology,
+                                          std::vector<std::string>& filenames) {
     size_t number_of_files = filenames.size();
     for (int i = 0; i < number_of_files; ++i) {
-        std::string filename = disk_pathes[i] + path.generic_string();
+        std::string filename =
+            topology.get_device(i).path + path.generic_string();
         auto res = create_or_truncate(filename);
         if (!res.ok()) {
             return res;
@@ -167,6 +494,19 @@ absl::Status StorageMetadata::create_files(
     return absl::OkStatus();
 }
 
+std::string StorageMetadata::serialize_device_table() const {
+    std::string table(device_table_size(number_of_files), '\0');
+    for (size_t i = 0; i < number_of_files; ++i) {
+        DeviceEntry entry{block_count_per_file[i], {}};
+        memcpy(table.data() + i * sizeof(DeviceEntry), &entry, sizeof(entry));
+    }
+    const uint64_t table_checksum =
+        fnv1a(table.data(), table.size() - sizeof(table_checksum));
+    memcpy(table.data() + table.size() - sizeof(table_checksum),
+           &table_checksum, sizeof(table_checksum));
+    return table;
+}
+
 absl::Status StorageMetadata::sync(const std::filesystem::path& path) const {
     const std::string meta_path = storage_metas_path + path.generic_string();
     auto res = create_or_truncate(meta_path);
@@ -174,19 +514,34 @@ absl::Status StorageMetadata::sync(const std::filesystem::path& path) const {
         return res;
     }
 
-    int fd = open(meta_path.c_str(), O_WRONLY);
-    std::string output_string = std::to_string(number_of_files) + "\n";
-    output_string += block_metadata_path.generic_string() + "\n";
-
+    std::string names;
+    auto append_name = [&names](const std::string& name) {
+        const uint32_t length = name.size();
+        names.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        names += name;
+    };
+    append_name(block_metadata_path.generic_string());
     for (auto& filename : filenames) {
-        output_string += filename + " ";
-    }
-    output_string += '\n';
-
-    for (auto num : block_count_per_file) {
-        output_string += std::to_string(num) + " ";
+        append_name(filename);
     }
+    const std::string table = serialize_device_table();
+
+    StorageMetadataHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kStorageMetadataMagic;
+    header.version = kStorageMetadataVersion;
+    header.number_of_files = number_of_files;
+    header.file_size = sizeof(header) + table.size() + names.size();
+    header.names_checksum = fnv1a(names.data(), names.size());
+    header.header_checksum =
+        fnv1a(&header, offsetof(StorageMetadataHeader, header_checksum));
+
+    std::string output_string(reinterpret_cast<const char*>(&header),
+                              sizeof(header));
+    output_string += table;
+    output_string += names;
 
+    int fd = open(meta_path.c_str(), O_WRONLY);
     size_t bytes_written =
         pwrite(fd, (void*)output_string.c_str(), output_string.size(), 0);
     close(fd);
@@ -197,6 +552,16 @@ absl::Status StorageMetadata::sync(const std::filesystem::path& path) const {
         "expected");
 }
 
+absl::Status StorageMetadata::sync_block_counts(int fd) const {
+    const std::string table = serialize_device_table();
+    const size_t bytes_written =
+        pwrite(fd, table.data(), table.size(), sizeof(StorageMetadataHeader));
+    if (bytes_written == table.size()) return absl::OkStatus();
+    return absl::UnknownError(
+        "StorageMetadata::sync_block_counts error: number of written bytes is "
+        "less than expected");
+}
+
 size_t StorageMetadata::block_count() const {
     size_t res = 0;
     for (int i = 0; i < number_of_files; ++i) {
@@ -222,7 +587,7 @@ std::ostream& operator<<(std::ostream& os, const StorageMetadata& metadata) {
 }
 
 BlockReader::BlockReader(int fd, size_t block_size, long offset)
-    : block_size(block_size) {
+    : block_size(block_size), buffer_pool(nullptr) {
     buffer = reinterpret_cast<char*>(aligned_alloc(512, block_size));
     const size_t bytes_read = pread(fd, buffer, block_size, offset);
     status = (bytes_read == block_size)
@@ -232,23 +597,80 @@ BlockReader::BlockReader(int fd, size_t block_size, long offset)
                        "less than expected");
 }
 
-BlockReader::BlockReader(const BlockReader& other)
-    : block_size(other.block_size) {
-    buffer = reinterpret_cast<char*>(aligned_alloc(512, block_size));
-    memcpy(buffer, other.buffer, block_size);
+BlockReader::BlockReader(std::shared_ptr<BufferPool> buffer_pool, int fd,
+                         long offset)
+    : BlockReader(std::move(buffer_pool)) {
+    const size_t bytes_read = pread(fd, buffer, block_size, offset);
+    status = (bytes_read == block_size)
+                 ? absl::OkStatus()
+                 : absl::UnknownError(
+                       "BlockReader::BlockReader error: number of read bytes is "
+                       "less than expected");
+}
+
+BlockReader::BlockReader(std::shared_ptr<BufferPool> buffer_pool, int fd,
+                         long offset, size_t read_size)
+    : BlockReader(std::move(buffer_pool)) {
+    const size_t bytes_read = pread(fd, buffer, read_size, offset);
+    status = (bytes_read == read_size)
+                 ? absl::OkStatus()
+                 : absl::UnknownError(
+                       "BlockReader::BlockReader error: number of read bytes is "
+                       "less than expected");
+}
+
+absl::Status BlockReader::read(int fd, long offset, size_t read_size) {
+    const size_t bytes_read = pread(fd, buffer, read_size, offset);
+    status = (bytes_read == read_size)
+                 ? absl::OkStatus()
+                 : absl::UnknownError(
+                       "BlockReader::read error: number of read bytes is less "
+                       "than expected");
+    return status;
 }
 
-BlockReader& BlockReader::operator=(const BlockReader& other) {
-    assert(block_size == other.block_size &&
-           "can't change BlockReader block size");
+absl::Status BlockReader::decode(size_t stored_size) {
+    // the values take more room than their encoding, so it is copied aside
+    const std::vector<char> encoded(buffer, buffer + stored_size);
+    return decode_block(encoded, std::span<int>(reinterpret_cast<int*>(buffer),
+                                                block_size / sizeof(int)));
+}
+
+BlockReader::BlockReader(std::shared_ptr<BufferPool> buffer_pool)
+    : block_size(buffer_pool->get_buffer_size()),
+      buffer(buffer_pool->acquire()),
+      buffer_pool(std::move(buffer_pool)) {}
+
+BlockReader::BlockReader(BlockReader&& other) noexcept
+    : block_size(other.block_size),
+      buffer(other.buffer),
+      buffer_pool(std::move(other.buffer_pool)),
+      status(std::move(other.status)) {
+    other.buffer = nullptr;
+}
+
+BlockReader& BlockReader::operator=(BlockReader&& other) noexcept {
     if (this != &other) {
-        buffer = reinterpret_cast<char*>(aligned_alloc(512, block_size));
-        memcpy(buffer, other.buffer, block_size);
+        release_buffer();
+        block_size = other.block_size;
+        buffer = other.buffer;
+        buffer_pool = std::move(other.buffer_pool);
+        status = std::move(other.status);
+        other.buffer = nullptr;
     }
     return *this;
 }
 
-BlockReader::~BlockReader() { free(buffer); }
+void BlockReader::release_buffer() {
+    if (buffer_pool != nullptr) {
+        buffer_pool->release(buffer);
+    } else {
+        free(buffer);
+    }
+    buffer = nullptr;
+}
+
+BlockReader::~BlockReader() { release_buffer(); }
 
 bool BlockReader::is_ok() const { return status.ok(); }
 
@@ -263,23 +685,123 @@ int BlockReader::read_char(size_t num) const { return buffer[num]; }
 
 std::string BlockReader::get_content()
     const {  // this function is mostly needed for testing
-    std::string str(buffer);
-    str.resize(block_size);
-    return str;
+    return std::string(buffer, block_size);
+}
+
+// the selections walk the placement cycle of the topology, which is plain
+// 0, 1, ..., number_of_files - 1 for identical devices
+StorageEngine::BlockId StorageEngine::round_robin_file_selection(
+    BlockId block_id) const {
+    return round_robin_device(block_id, placement_cycle);
 }
 
-StorageEngine::BlockId StorageEngine::round_robin_file_selection() const {
-    return next_id % storage_metadata.number_of_files;
+StorageEngine::BlockId StorageEngine::one_disk_selection(
+    BlockId /*block_id*/) const {
+    return 0;
 }
 
-StorageEngine::BlockId StorageEngine::one_disk_selection() const { return 0; }
+StorageEngine::BlockId StorageEngine::batched_round_robin_selection(
+    BlockId block_id) const {
+    return batched_round_robin_device(block_id, placement_cycle, batch_size);
+}
 
-StorageEngine::BlockId StorageEngine::batched_round_robin_selection() const {
-    return (next_id / batch_size) % storage_metadata.number_of_files;
+StorageEngine::BlockId StorageEngine::shift6_selection(BlockId block_id) const {
+    return shift6_device(block_id, placement_cycle);
 }
 
-StorageEngine::BlockId StorageEngine::shift6_selection() const {
-    return (next_id + next_id / kNumberOfFiles) % kNumberOfFiles;
+StorageEngine::BlockId StorageEngine::heat_aware_selection(
+    BlockId block_id) const {
+    if (block_id < heat_placement.size()) return heat_placement[block_id];
+    return round_robin_file_selection(block_id);
+}
+
+size_t StorageEngine::explicit_block_device(BlockId block_id) const {
+    if (placement_map != nullptr) {
+        if (!placement_map->is_row_group_map() &&
+            block_id < placement_map->size()) {
+            return placement_map->device(block_id);
+        }
+    } else if (block_id < explicit_placement.size()) {
+        return explicit_placement[block_id];
+    }
+    return storage_metadata.number_of_files;
+}
+
+StorageEngine::BlockId StorageEngine::explicit_selection(
+    BlockId block_id) const {
+    const size_t file_id = explicit_block_device(block_id);
+    if (file_id < storage_metadata.number_of_files) return file_id;
+    return round_robin_file_selection(block_id);
+}
+
+size_t StorageEngine::select_file(BlockId block_id) const {
+    switch (mode) {
+    case IdSelectionMode::RoundRobin:
+        return round_robin_file_selection(block_id);
+    case IdSelectionMode::OneDisk:
+        return one_disk_selection(block_id);
+    case IdSelectionMode::BatchedRoundRobin:
+        return batched_round_robin_selection(block_id);
+    case IdSelectionMode::Shift6:
+        return shift6_selection(block_id);
+    case IdSelectionMode::HeatAware:
+        return heat_aware_selection(block_id);
+    case IdSelectionMode::Explicit:
+        return explicit_selection(block_id);
+    default:
+        return round_robin_file_selection(block_id);
+    }
+}
+
+bool StorageEngine::has_room(size_t file_id, size_t pending_blocks) const {
+    const size_t capacity = topology.get_device(file_id).capacity;
+    if (capacity == 0) return true;
+    const size_t block_count =
+        storage_metadata.block_count_per_file[file_id] + pending_blocks;
+    return (block_count + 1) * block_size <= capacity;
+}
+
+size_t StorageEngine::select_column_file(const ColumnInfo& column,
+                                         size_t row_group) const {
+    const size_t number_of_files = storage_metadata.number_of_files;
+    if (mode == IdSelectionMode::Explicit) {
+        // a map per block id already says where each block of the column
+        // goes, a map per row group says where the row group goes
+        const size_t file_id =
+            explicit_block_device(column.first_block + row_group);
+        if (file_id < number_of_files) return file_id;
+        if (placement_map != nullptr && placement_map->is_row_group_map() &&
+            row_group < placement_map->size()) {
+            size_t offset = 0;
+            if (column.column_index < placement_map->get_column_count()) {
+                offset = placement_map->column_offset(column.column_index);
+            } else if (column.placement == ColumnPlacement::Spread) {
+                offset = column.column_index;
+            }
+            return (placement_map->device(row_group) + offset) %
+                   number_of_files;
+        }
+    }
+    const size_t file_id = select_file(row_group);
+    if (column.placement == ColumnPlacement::Colocate) return file_id;
+    return (file_id + column.column_index) % number_of_files;
+}
+
+absl::StatusOr<size_t> StorageEngine::place_block(
+    size_t file_id, const std::vector<size_t>* pending_per_file) const {
+    auto pending = [&](size_t file_id) -> size_t {
+        return (pending_per_file == nullptr) ? 0 : (*pending_per_file)[file_id];
+    };
+    if (has_room(file_id, pending(file_id))) return file_id;
+
+    // the selected device is full, take the next one of the cycle with room
+    for (size_t i = 0; i < storage_metadata.number_of_files; ++i) {
+        const size_t next_file_id =
+            (file_id + 1 + i) % storage_metadata.number_of_files;
+        if (has_room(next_file_id, pending(next_file_id))) return next_file_id;
+    }
+    return absl::ResourceExhaustedError(
+        "StorageEngine::create_block error: all devices are full");
 }
 
 absl::StatusOr<BlockMetadata> StorageEngine::get_block_metadata_from_file(
@@ -297,7 +819,46 @@ absl::StatusOr<BlockMetadata> StorageEngine::get_block_metadata_from_file(
 }
 
 BlockMetadata StorageEngine::get_block_metadata(size_t block_id) const {
-    return block_metadata_cache[block_id];
+    if (block_id < mapped_block_count) return block_metadata_map[block_id];
+    return block_metadata_cache[block_id - mapped_block_count];
+}
+
+absl::Status StorageEngine::set_block_metadata(
+    BlockId block_id, const BlockMetadata& block_metadata) {
+    // a mapped entry sees the write through the shared mapping
+    auto res = block_metadata.sync(block_metadata_fd, block_id);
+    if (!res.ok()) return res;
+    if (block_id >= mapped_block_count) {
+        block_metadata_cache[block_id - mapped_block_count] = block_metadata;
+    }
+    return absl::OkStatus();
+}
+
+absl::StatusOr<StorageEngine::BlockId> StorageEngine::find_block(
+    short file_id, long offset) const {
+    for (BlockId block_id = 0; block_id < next_id; ++block_id) {
+        const BlockMetadata block_metadata = get_block_metadata(block_id);
+        if (block_metadata.file_id == file_id &&
+            block_metadata.offset == offset) {
+            return block_id;
+        }
+    }
+    return absl::NotFoundError(
+        "StorageEngine::find_block error: no block in the slot");
+}
+
+absl::Status StorageEngine::copy_block(const BlockMetadata& from,
+                                       const BlockMetadata& to) {
+    BlockReader block_reader(buffer_pool, fd_cache[from.file_id], from.offset);
+    if (!block_reader.is_ok()) return block_reader.get_status();
+    const size_t bytes_written =
+        pwrite(fd_cache[to.file_id], block_reader.buffer, block_size, to.offset);
+    if (bytes_written != block_size) {
+        return absl::UnknownError(
+            "StorageEngine::copy_block error: number of written bytes is less "
+            "than expected");
+    }
+    return absl::OkStatus();
 }
 
 StorageEngine::StorageEngine(
@@ -315,7 +876,8 @@ StorageEngine::StorageEngine(
       block_metadata_cache(block_metadata_cache),
       fd_cache(fd_cache),
       block_metadata_fd(block_metadata_fd),
-      batch_size(batch_size) {}
+      batch_size(batch_size),
+      heat_tracker(std::make_unique<HeatTracker>()) {}
 
 StorageEngine::StorageEngine(StorageEngine::IdSelectionMode mode,
                              size_t block_size,
@@ -330,18 +892,33 @@ StorageEngine::StorageEngine(StorageEngine::IdSelectionMode mode,
       block_metadata_cache(),
       fd_cache(),
       block_metadata_fd(),
-      batch_size(batch_size) {}
+      batch_size(batch_size),
+      heat_tracker(std::make_unique<HeatTracker>()) {}
 
 StorageEngine::StorageEngine(const StorageEngine& other)
     : StorageEngine(other.mode, other.block_size, other.path, other.next_id,
                     other.storage_metadata, other.batch_size) {
-    auto res = open_caches();
+    buffer_pool = other.buffer_pool;
+    metadata_load_mode = other.metadata_load_mode;
+    topology = other.topology;
+    placement_cycle = other.placement_cycle;
+    heat_placement = other.heat_placement;
+    explicit_placement = other.explicit_placement;
+    placement_map = other.placement_map;
+    trace_recorder = other.trace_recorder;
+    columns = other.columns;
+    block_compression = other.block_compression;
+    set_heat_half_life(other.heat_half_life);
+    // the copy reads the metadata files, so journaled blocks must be there
+    auto res = other.checkpoint();
+    assert(res.ok());
+    res = open_caches();
     assert(res.ok());
 }
 
 absl::Status StorageEngine::open_caches() {
     fd_cache.resize(0);
-    for (int i = 0; i < kNumberOfFiles; ++i) {
+    for (int i = 0; i < storage_metadata.number_of_files; ++i) {
         int fd = open(storage_metadata.filenames[i].c_str(), O_RDWR | O_DIRECT);
         if (fd < 0) {
             return absl::UnavailableError(
@@ -355,63 +932,383 @@ absl::Status StorageEngine::open_caches() {
         return absl::UnavailableError(
             "StorageEngine::create error: opening block metadata file failed");
     }
-    auto block_count = storage_metadata.block_count();
+    const std::string meta_path = storage_metas_path + path.generic_string();
+    storage_metadata_fd = open(meta_path.c_str(), O_WRONLY);
+    if (storage_metadata_fd < 0) {
+        return absl::UnavailableError(
+            "StorageEngine::create error: opening storage metadata file failed");
+    }
+    if (io_stats == nullptr) {
+        io_stats = std::make_unique<IoStats>(storage_metadata.number_of_files);
+    }
+    auto res = load_zone_maps();
+    if (!res.ok()) return res;
+    res = load_columns();
+    if (!res.ok()) return res;
+    grow_block_tables();
+    return load_block_metadata();
+}
+
+absl::Status StorageEngine::load_zone_maps() {
+    zone_map_fd = open(get_zone_map_path(path).c_str(), O_RDWR | O_CREAT, 0666);
+    if (zone_map_fd < 0) {
+        return absl::UnavailableError(
+            "StorageEngine::create error: opening zone map file failed");
+    }
+    struct stat file_stat;
+    if (fstat(zone_map_fd, &file_stat) != 0) {
+        return absl::UnavailableError(
+            "StorageEngine::load_zone_maps error: fstat failed");
+    }
+    // blocks that were never written have no entry yet
+    zone_maps.assign(next_id, BlockZoneMap());
+    const size_t bytes = std::min<size_t>(file_stat.st_size / sizeof(BlockZoneMap),
+                                          next_id) *
+                         sizeof(BlockZoneMap);
+    if (pread(zone_map_fd, zone_maps.data(), bytes, 0) !=
+        static_cast<ssize_t>(bytes)) {
+        return absl::UnavailableError(
+            "StorageEngine::load_zone_maps error: read failed");
+    }
+    return absl::OkStatus();
+}
+
+absl::Status StorageEngine::load_columns() {
+    columns.clear();
+    std::ifstream in(get_columns_path(path));
+    if (!in.is_open()) return absl::OkStatus();  // no column was created
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        std::istringstream line_in(line);
+        ColumnInfo column;
+        int placement = 0;
+        if (!(line_in >> column.name >> column.first_block >>
+              column.block_count >> placement)) {
+            return absl::DataLossError(
+                "StorageEngine::load_columns error: malformed column catalog");
+        }
+        if (column.first_block + column.block_count > next_id) {
+            return absl::DataLossError(
+                "StorageEngine::load_columns error: column " + column.name +
+                " has blocks past the end of the storage");
+        }
+        column.column_index = columns.size();
+        column.placement = static_cast<ColumnPlacement>(placement);
+        // catalogs written before value types hold full int blocks
+        int value_type = 0;
+        if (line_in >> value_type >> column.row_count) {
+            column.value_type = static_cast<ValueType>(value_type);
+        } else {
+            column.value_type = ValueType::Int32;
+            column.row_count =
+                column.block_count * (block_size / value_size(ValueType::Int32));
+        }
+        columns.emplace_back(column);
+    }
+    return absl::OkStatus();
+}
+
+absl::Status StorageEngine::sync_columns() const {
+    // written aside and renamed, so that a crash keeps the old catalog
+    const std::filesystem::path columns_path = get_columns_path(path);
+    std::filesystem::path tmp_path = columns_path;
+    tmp_path += ".tmp";
+    std::ofstream out(tmp_path, std::ios::trunc);
+    if (out.fail()) {
+        return absl::UnavailableError(
+            "StorageEngine::sync_columns error: ofstream open failed");
+    }
+    for (const ColumnInfo& column : columns) {
+        out << column.name << ' ' << column.first_block << ' '
+            << column.block_count << ' ' << static_cast<int>(column.placement)
+            << ' ' << static_cast<int>(column.value_type) << ' '
+            << column.row_count << '\n';
+    }
+    out.close();
+    if (out.fail()) {
+        return absl::UnknownError(
+            "StorageEngine::sync_columns error: writing failed");
+    }
+    std::error_code error;
+    std::filesystem::rename(tmp_path, columns_path, error);
+    if (error) {
+        return absl::UnknownError(
+            "StorageEngine::sync_columns error: rename failed");
+    }
+    return absl::OkStatus();
+}
+
+void StorageEngine::grow_block_tables() {
+    heat_tracker->resize(next_id);
+    zone_maps.resize(next_id);
+}
+
+absl::Status StorageEngine::update_zone_map(BlockId block_id,
+                                            const char* buffer,
+                                            BlockEncoding encoding,
+                                            size_t stored_size) {
+    BlockZoneMap zone_map(std::span<const int>(
+        reinterpret_cast<const int*>(buffer), block_size / sizeof(int)));
+    zone_map.encoding = encoding;
+    if (encoding != BlockEncoding::Plain) {
+        zone_map.stored_sectors = stored_size / kSectorSize;
+    }
+    zone_maps[block_id] = zone_map;
+    const size_t bytes_written = pwrite(zone_map_fd, &zone_map, sizeof(zone_map),
+                                        block_id * sizeof(zone_map));
+    if (bytes_written != sizeof(zone_map)) {
+        return absl::UnknownError(
+            "StorageEngine::update_zone_map error: number of written bytes is "
+            "less than expected");
+    }
+    return absl::OkStatus();
+}
+
+absl::Status StorageEngine::load_block_metadata() {
+    const size_t block_count = storage_metadata.block_count();
     block_metadata_cache.resize(0);
-    for (size_t block_id = 0; block_id < block_count; ++block_id) {
-        auto res = get_block_metadata_from_file(block_id, block_metadata_fd);
-        if (!res.ok()) {
-            return res.status();
+    unmap_block_metadata();
+
+    if (metadata_load_mode == MetadataLoadMode::Mmap && block_count > 0) {
+        const size_t map_size = block_count * sizeof(BlockMetadata);
+        void* map = mmap(nullptr, map_size, PROT_READ, MAP_SHARED,
+                         block_metadata_fd, 0);
+        if (map == MAP_FAILED) {
+            return absl::UnavailableError(
+                "StorageEngine::load_block_metadata error: mmap failed");
+        }
+        block_metadata_map = reinterpret_cast<const BlockMetadata*>(map);
+        mapped_block_count = block_count;
+        return absl::OkStatus();
+    }
+
+    block_metadata_cache.resize(block_count);
+    for (size_t first = 0; first < block_count;
+         first += kBlockMetadataChunkSize) {
+        const size_t chunk_bytes =
+            std::min(kBlockMetadataChunkSize, block_count - first) *
+            sizeof(BlockMetadata);
+        const size_t bytes_read =
+            pread(block_metadata_fd, block_metadata_cache.data() + first,
+                  chunk_bytes, first * sizeof(BlockMetadata));
+        if (bytes_read != chunk_bytes) {
+            return absl::UnavailableError(
+                "StorageEngine::load_block_metadata error: read failed");
         }
-        block_metadata_cache.emplace_back(res.value());
     }
     return absl::OkStatus();
 }
 
+void StorageEngine::unmap_block_metadata() {
+    if (block_metadata_map != nullptr) {
+        munmap(const_cast<BlockMetadata*>(block_metadata_map),
+               mapped_block_count * sizeof(BlockMetadata));
+    }
+    block_metadata_map = nullptr;
+    mapped_block_count = 0;
+}
+
 absl::StatusOr<StorageEngine> StorageEngine::create(
     const std::filesystem::path& path, StorageEngine::IdSelectionMode mode,
-    size_t block_size, size_t batch_size) {
+    size_t block_size, size_t batch_size,
+    StorageEngine::MetadataLoadMode metadata_load_mode,
+    const DeviceTopology& topology) {
     size_t next_id = 0;
-    auto create_res = StorageMetadata::create(path);
+    auto create_res = StorageMetadata::create(path, topology);
     if (!create_res.ok()) {
         return create_res.status();
     }
 
-    StorageMetadata storage_metadata = StorageMetadata::create(path).value();
+    StorageMetadata storage_metadata = std::move(create_res.value());
     next_id = storage_metadata.block_count();
 
     StorageEngine storage_engine = StorageEngine(mode, block_size, path, next_id,
                                                  storage_metadata, batch_size);
+    storage_engine.metadata_load_mode = metadata_load_mode;
+    storage_engine.topology = topology;
+    storage_engine.placement_cycle = topology.placement_cycle();
     auto res = storage_engine.open_caches();
     if (!res.ok()) return res;
+    res = storage_engine.configure_buffer_pool(kDefaultBufferCount);
+    if (!res.ok()) return res;
     return storage_engine;
 }
 
+absl::Status StorageEngine::configure_buffer_pool(size_t buffer_count,
+                                                  bool use_hugepages) {
+    auto pool_res = BufferPool::create(block_size, buffer_count, use_hugepages);
+    if (!pool_res.ok()) return pool_res.status();
+    buffer_pool = std::move(pool_res.value());
+    return absl::OkStatus();
+}
+
+std::shared_ptr<BufferPool> StorageEngine::get_buffer_pool() const {
+    return buffer_pool;
+}
+
 StorageEngine::~StorageEngine() {
-    for (int i = 0; i < kNumberOfFiles; ++i) {
+    checkpoint().IgnoreError();
+    allocation_journal.reset();
+    for (int i = 0; i < fd_cache.size(); ++i) {
         close(fd_cache[i]);
     }
+    unmap_block_metadata();
     close(block_metadata_fd);
+    close(storage_metadata_fd);
+    close(zone_map_fd);
 }
 
-absl::StatusOr<StorageEngine::BlockId> StorageEngine::create_block() {
-    size_t file_id;
-    switch (mode) {
-    case IdSelectionMode::RoundRobin:
-        file_id = round_robin_file_selection();
-        break;
-    case IdSelectionMode::OneDisk:
-        file_id = one_disk_selection();
-        break;
-    case IdSelectionMode::BatchedRoundRobin:
-        file_id = batched_round_robin_selection();
-        break;
-    case IdSelectionMode::Shift6:
-        file_id = shift6_selection();
-        break;
-    default:
-        file_id = round_robin_file_selection();
+absl::Status StorageEngine::enable_allocation_journal(
+    size_t group_size, size_t checkpoint_interval) {
+    auto checkpoint_res = checkpoint();
+    if (!checkpoint_res.ok()) return checkpoint_res;
+    auto open_res = AllocationJournal::open(path, group_size);
+    if (!open_res.ok()) return open_res.status();
+
+    allocation_journal = std::move(open_res.value());
+    journal_group_size = std::max<size_t>(group_size, 1);
+    journal_checkpoint_interval = std::max<size_t>(checkpoint_interval, 1);
+    checkpointed_id = next_id;
+    reserved_blocks_per_file = storage_metadata.block_count_per_file;
+    return absl::OkStatus();
+}
+
+absl::Status StorageEngine::checkpoint() const {
+    if (allocation_journal == nullptr || checkpointed_id == next_id) {
+        return absl::OkStatus();
+    }
+
+    std::vector<BlockMetadata> block_metadata_batch;
+    block_metadata_batch.reserve(next_id - checkpointed_id);
+    for (BlockId block_id = checkpointed_id; block_id < next_id; ++block_id) {
+        block_metadata_batch.emplace_back(get_block_metadata(block_id));
+    }
+    const size_t batch_bytes =
+        block_metadata_batch.size() * sizeof(BlockMetadata);
+    const size_t bytes_written =
+        pwrite(block_metadata_fd, block_metadata_batch.data(), batch_bytes,
+               checkpointed_id * sizeof(BlockMetadata));
+    if (bytes_written != batch_bytes || fdatasync(block_metadata_fd) != 0) {
+        return absl::UnknownError(
+            "StorageEngine::checkpoint error: writing block metadata failed");
+    }
+    auto sync_res = storage_metadata.sync_block_counts(storage_metadata_fd);
+    if (!sync_res.ok()) return sync_res;
+    if (fdatasync(storage_metadata_fd) != 0) {
+        return absl::UnknownError(
+            "StorageEngine::checkpoint error: syncing storage metadata failed");
     }
 
+    auto truncate_res = allocation_journal->truncate();
+    if (!truncate_res.ok()) return truncate_res;
+    checkpointed_id = next_id;
+    return absl::OkStatus();
+}
+
+absl::StatusOr<StorageEngine::BlockId> StorageEngine::create_journaled_block(
+    size_t file_id) {
+    const size_t block_count = storage_metadata.block_count_per_file[file_id];
+    const size_t offset = block_count * block_size;
+
+    // device files grow a whole journal group at a time
+    if (block_count >= reserved_blocks_per_file[file_id]) {
+        const long extent_size = journal_group_size * block_size;
+        if (fallocate(fd_cache[file_id], 0, offset, extent_size) != 0 &&
+            ftruncate(fd_cache[file_id], offset + extent_size) != 0) {
+            return absl::UnavailableError(
+                "StorageEngine::create_block error: extending block file "
+                "failed");
+        }
+        reserved_blocks_per_file[file_id] = block_count + journal_group_size;
+    }
+
+    auto res = allocation_journal->append(JournalRecord(next_id, file_id, offset));
+    if (!res.ok()) return res;
+    block_metadata_cache.emplace_back(file_id, offset);
+    storage_metadata.block_count_per_file[file_id] += 1;
+
+    const BlockId block_id = next_id++;
+    grow_block_tables();
+    if (next_id - checkpointed_id >= journal_checkpoint_interval) {
+        auto checkpoint_res = checkpoint();
+        if (!checkpoint_res.ok()) return checkpoint_res;
+    }
+    return block_id;
+}
+
+void StorageEngine::set_block_heat(const std::vector<double>& heat) {
+    heat_placement = lpt_placement(heat, topology);
+}
+
+void StorageEngine::set_block_heat(const std::vector<size_t>& access_counts) {
+    set_block_heat(std::vector<double>(access_counts.begin(), access_counts.end()));
+}
+
+absl::Status StorageEngine::set_block_placement(
+    const std::vector<short>& placement) {
+    for (short file_id : placement) {
+        if (file_id < 0 || static_cast<size_t>(file_id) >= topology.size()) {
+            return absl::InvalidArgumentError(
+                "StorageEngine::set_block_placement error: device id out of "
+                "range");
+        }
+    }
+    explicit_placement = placement;
+    placement_map.reset();
+    return absl::OkStatus();
+}
+
+absl::Status StorageEngine::load_block_placement(
+    const std::filesystem::path& path) {
+    auto map_res = PlacementMap::open(path);
+    if (!map_res.ok()) return map_res.status();
+    if ((*map_res)->get_number_of_devices() > topology.size()) {
+        return absl::InvalidArgumentError(
+            "StorageEngine::load_block_placement error: map has more devices "
+            "than the store");
+    }
+    placement_map = std::move(map_res.value());
+    explicit_placement.clear();
+    return absl::OkStatus();
+}
+
+std::vector<double> StorageEngine::get_block_heat() const {
+    return heat_tracker->snapshot();
+}
+
+void StorageEngine::set_heat_half_life(std::chrono::milliseconds half_life) {
+    heat_half_life = half_life;
+    heat_tracker->set_half_life(half_life);
+}
+
+absl::Status StorageEngine::export_block_heat(
+    const std::filesystem::path& path) const {
+    const std::vector<double> heat = get_block_heat();
+    std::ofstream out(path, std::ios::trunc);
+    if (out.fail()) {
+        return absl::UnavailableError(
+            "StorageEngine::export_block_heat error: ofstream open failed");
+    }
+    out << "block_id,file_id,heat\n";
+    for (BlockId block_id = 0; block_id < heat.size(); ++block_id) {
+        out << block_id << ',' << get_block_file_id(block_id) << ','
+            << heat[block_id] << '\n';
+    }
+    out.close();
+    if (out.fail()) {
+        return absl::UnknownError(
+            "StorageEngine::export_block_heat error: writing failed");
+    }
+    return absl::OkStatus();
+}
+
+absl::StatusOr<StorageEngine::BlockId> StorageEngine::create_block() {
+    auto place_res = place_block(select_file(next_id));
+    if (!place_res.ok()) return place_res.status();
+    const size_t file_id = *place_res;
+    if (allocation_journal != nullptr) return create_journaled_block(file_id);
+
     const size_t offset =
         storage_metadata.block_count_per_file[file_id] * block_size;
     const BlockMetadata block_metadata = BlockMetadata(file_id, offset);
@@ -424,14 +1321,97 @@ absl::StatusOr<StorageEngine::BlockId> StorageEngine::create_block() {
     block_metadata_cache.emplace_back(block_metadata);
 
     storage_metadata.block_count_per_file[file_id] += 1;
-    auto sync_res = storage_metadata.sync(path);
+    auto sync_res = storage_metadata.sync_block_counts(storage_metadata_fd);
     if (!sync_res.ok()) return sync_res;
-    return next_id++;
+    const BlockId block_id = next_id++;
+    grow_block_tables();
+    return block_id;
+}
+
+absl::StatusOr<StorageEngine::BlockId> StorageEngine::create_blocks(
+    size_t block_count) {
+    return create_blocks(block_count, [this](BlockId block_id) {
+        return select_file(block_id);
+    });
+}
+
+absl::StatusOr<StorageEngine::BlockId> StorageEngine::create_blocks(
+    size_t block_count, const std::function<size_t(BlockId)>& select) {
+    // the batch updates the metadata files directly, so they must not lag
+    // behind the journal
+    auto checkpoint_res = checkpoint();
+    if (!checkpoint_res.ok()) return checkpoint_res;
+
+    const size_t first_id = next_id;
+    const size_t number_of_files = storage_metadata.number_of_files;
+    std::vector<size_t> new_blocks_per_file(number_of_files, 0);
+
+    std::vector<BlockMetadata> block_metadata_batch;
+    block_metadata_batch.reserve(block_count);
+    for (size_t i = 0; i < block_count; ++i) {
+        auto place_res =
+            place_block(select(first_id + i), &new_blocks_per_file);
+        if (!place_res.ok()) return place_res.status();
+        const size_t file_id = *place_res;
+        const size_t offset = (storage_metadata.block_count_per_file[file_id] +
+                               new_blocks_per_file[file_id]) *
+                              block_size;
+        block_metadata_batch.emplace_back(file_id, offset);
+        new_blocks_per_file[file_id] += 1;
+    }
+
+    for (size_t file_id = 0; file_id < number_of_files; ++file_id) {
+        if (new_blocks_per_file[file_id] == 0) continue;
+        const long old_size =
+            storage_metadata.block_count_per_file[file_id] * block_size;
+        const long extent_size = new_blocks_per_file[file_id] * block_size;
+        if (fallocate(fd_cache[file_id], 0, old_size, extent_size) != 0) {
+            // the file system can't preallocate, at least extend the file
+            if (ftruncate(fd_cache[file_id], old_size + extent_size) != 0) {
+                return absl::UnavailableError(
+                    "StorageEngine::create_blocks error: extending block file "
+                    "failed");
+            }
+        }
+    }
+
+    const size_t batch_bytes = sizeof(BlockMetadata) * block_count;
+    const size_t bytes_written =
+        pwrite(block_metadata_fd, block_metadata_batch.data(), batch_bytes,
+               sizeof(BlockMetadata) * first_id);
+    if (bytes_written != batch_bytes) {
+        return absl::UnknownError(
+            "StorageEngine::create_blocks error: number of written bytes is "
+            "less than expected");
+    }
+    block_metadata_cache.insert(block_metadata_cache.end(),
+                                block_metadata_batch.begin(),
+                                block_metadata_batch.end());
+
+    for (size_t file_id = 0; file_id < number_of_files; ++file_id) {
+        storage_metadata.block_count_per_file[file_id] +=
+            new_blocks_per_file[file_id];
+    }
+    auto sync_res = storage_metadata.sync_block_counts(storage_metadata_fd);
+    if (!sync_res.ok()) return sync_res;
+
+    next_id += block_count;
+    grow_block_tables();
+    if (allocation_journal != nullptr) {
+        checkpointed_id = next_id;
+        for (size_t file_id = 0; file_id < number_of_files; ++file_id) {
+            reserved_blocks_per_file[file_id] =
+                std::max(reserved_blocks_per_file[file_id],
+                         storage_metadata.block_count_per_file[file_id]);
+        }
+    }
+    return first_id;
 }
 
 absl::StatusOr<BlockReader> StorageEngine::get_block(
     StorageEngine::BlockId block_id) const {
-    if (block_id > storage_metadata.block_count()) {
+    std::shared_lock lock(block_table_mutex);
+    if (block_id >= storage_metadata.block_count()) {
         return absl::UnavailableError(
             "StorageEngine::get_block error: invalid block_id");
     }
@@ -442,14 +1422,172 @@ absl::StatusOr<BlockReader> StorageEngine::get_block(
             "StorageEngine::get_block error: invalid file descriptor");
     }
     const BlockMetadata block_metadata = get_block_metadata(block_id);
-    auto block_reader = BlockReader(fd, block_size, block_metadata.offset);
+    const size_t stored_size = get_stored_size(block_id);
+    const auto start = io_stats->begin_io(block_metadata.file_id);
+    auto block_reader =
+        BlockReader(buffer_pool, fd, block_metadata.offset, stored_size);
+    io_stats->end_read(block_metadata.file_id, start,
+                       block_reader.is_ok() ? stored_size : 0);
+    trace(TraceOperation::Read, block_id, block_metadata.file_id, start);
     if (!block_reader.is_ok()) {
         return block_reader.get_status();
     }
+    if (stored_size != block_size) {
+        auto res = block_reader.decode(stored_size);
+        if (!res.ok()) return res;
+    }
+    heat_tracker->record(block_id);
     return block_reader;
 }
 
+absl::StatusOr<BlockReader> StorageEngine::get_encoded_block(
+    StorageEngine::BlockId block_id) const {
+    std::shared_lock lock(block_table_mutex);
+    if (block_id >= storage_metadata.block_count()) {
+        return absl::UnavailableError(
+            "StorageEngine::get_encoded_block error: invalid block_id");
+    }
+
+    const BlockMetadata block_metadata = get_block_metadata(block_id);
+    const size_t stored_size = get_stored_size(block_id);
+    const auto start = io_stats->begin_io(block_metadata.file_id);
+    auto block_reader = BlockReader(buffer_pool, get_block_file_fd(block_id),
+                                    block_metadata.offset, stored_size);
+    io_stats->end_read(block_metadata.file_id, start,
+                       block_reader.is_ok() ? stored_size : 0);
+    trace(TraceOperation::Read, block_id, block_metadata.file_id, start);
+    if (!block_reader.is_ok()) {
+        return block_reader.get_status();
+    }
+    heat_tracker->record(block_id);
+    return block_reader;
+}
+
+size_t StorageEngine::get_stored_size(BlockId block_id) const {
+    const BlockZoneMap& zone_map = zone_maps[block_id];
+    if (zone_map.encoding == BlockEncoding::Plain) return block_size;
+    return zone_map.stored_sectors * kSectorSize;
+}
+
+absl::StatusOr<std::vector<BlockReader>> StorageEngine::get_blocks(
+    std::span<const StorageEngine::BlockId> block_ids,
+    size_t queue_depth) const {
+    std::shared_lock lock(block_table_mutex);
+    const size_t block_count = storage_metadata.block_count();
+    for (auto block_id : block_ids) {
+        if (block_id >= block_count) {
+            return absl::UnavailableError(
+                "StorageEngine::get_blocks error: invalid block_id");
+        }
+    }
+    if (queue_depth == 0) queue_depth = 1;
+    for (auto block_id : block_ids) {
+        heat_tracker->record(block_id);
+    }
+
+    const size_t number_of_files = storage_metadata.number_of_files;
+    // buffers must not move while reads are in flight, so allocate all of
+    // them before submitting anything
+    std::vector<BlockReader> block_readers;
+    block_readers.reserve(block_ids.size());
+    std::vector<std::vector<size_t>> pending(number_of_files);
+    for (size_t i = 0; i < block_ids.size(); ++i) {
+        block_readers.emplace_back(buffer_pool);
+        pending[get_block_metadata(block_ids[i]).file_id].emplace_back(i);
+    }
+    std::vector<bool> read_done(block_ids.size(), false);
+
+    // the ring lives only for this call, so concurrent callers never share
+    // a submission queue
+    auto ring_res = IoUring::create(queue_depth * number_of_files);
+    std::vector<IoStats::Clock::time_point> starts(block_ids.size());
+    std::vector<size_t> next_pending(number_of_files, 0);
+    std::vector<size_t> in_flight(number_of_files, 0);
+    size_t total_in_flight = 0;
+    size_t completed = 0;
+    absl::Status status = absl::OkStatus();
+
+    while (ring_res.ok() && completed < block_ids.size()) {
+        IoUring& ring = *ring_res;
+        if (status.ok()) {
+            for (size_t file_id = 0; file_id < number_of_files; ++file_id) {
+                while (in_flight[file_id] < queue_depth &&
+                       next_pending[file_id] < pending[file_id].size()) {
+                    const size_t i = pending[file_id][next_pending[file_id]];
+                    const BlockMetadata block_metadata =
+                        get_block_metadata(block_ids[i]);
+                    if (!ring.queue_read(fd_cache[file_id],
+                                         block_readers[i].buffer,
+                                         get_stored_size(block_ids[i]),
+                                         block_metadata.offset, i)) {
+                        break;
+                    }
+                    starts[i] = io_stats->begin_io(file_id);
+                    ++next_pending[file_id];
+                    ++in_flight[file_id];
+                    ++total_in_flight;
+                }
+            }
+        }
+        if (total_in_flight == 0) break;  // only after an error
+
+        auto submit_res = ring.submit_and_wait(1);
+        if (!submit_res.ok()) {
+            // what is in flight can't be reaped anymore: closing the ring
+            // cancels the reads the kernel hasn't started, and the blocks
+            // not read yet are read again below into the same buffers
+            ring_res = submit_res;
+            break;
+        }
+
+        uint64_t i;
+        int result;
+        while (ring.pop_completion(i, result)) {
+            const size_t file_id = get_block_metadata(block_ids[i]).file_id;
+            io_stats->end_read(file_id, starts[i], std::max(result, 0));
+            trace(TraceOperation::Read, block_ids[i], file_id, starts[i]);
+            --in_flight[file_id];
+            --total_in_flight;
+            ++completed;
+            read_done[i] = true;
+            if (result != static_cast<int>(get_stored_size(block_ids[i])) &&
+                status.ok()) {
+                status = absl::UnknownError(
+                    "StorageEngine::get_blocks error: number of read bytes is "
+                    "less than expected");
+            }
+        }
+    }
+
+    if (!status.ok()) return status;
+
+    // io_uring may be unavailable (old kernel, seccomp) or fail on the way,
+    // the rest is read with blocking reads
+    for (size_t i = 0; i < block_ids.size() && !ring_res.ok(); ++i) {
+        if (read_done[i]) continue;
+        const BlockMetadata block_metadata = get_block_metadata(block_ids[i]);
+        const size_t stored_size = get_stored_size(block_ids[i]);
+        const auto start = io_stats->begin_io(block_metadata.file_id);
+        auto res = block_readers[i].read(get_block_file_fd(block_ids[i]),
+                                         block_metadata.offset, stored_size);
+        io_stats->end_read(block_metadata.file_id, start,
+                           res.ok() ? stored_size : 0);
+        trace(TraceOperation::Read, block_ids[i], block_metadata.file_id,
+              start);
+        if (!res.ok()) return res;
+    }
+
+    for (size_t i = 0; i < block_ids.size(); ++i) {
+        const size_t stored_size = get_stored_size(block_ids[i]);
+        if (stored_size == block_size) continue;
+        auto res = block_readers[i].decode(stored_size);
+        if (!res.ok()) return res;
+    }
+    return block_readers;
+}
+
 absl::Status StorageEngine::counting_get_block(StorageEngine::BlockId block_id, std::vector<size_t>& cnt) const {
+    std::shared_lock lock(block_table_mutex);
     BlockMetadata block_metadata = get_block_metadata(block_id);
     auto file_id = block_metadata.file_id;
 
@@ -457,9 +1595,70 @@ absl::Status StorageEngine::counting_get_block(StorageEngine::BlockId block_id,
     return absl::OkStatus();
 }
 
+absl::Status StorageEngine::migrate_block(StorageEngine::BlockId block_id,
+                                          size_t target_file_id) {
+    if (block_id >= next_id) {
+        return absl::UnavailableError(
+            "StorageEngine::migrate_block error: invalid block_id");
+    }
+    if (target_file_id >= storage_metadata.number_of_files) {
+        return absl::InvalidArgumentError(
+            "StorageEngine::migrate_block error: invalid target device");
+    }
+    // a journal replay would bring back the old location
+    auto checkpoint_res = checkpoint();
+    if (!checkpoint_res.ok()) return checkpoint_res;
+
+    std::unique_lock lock(block_table_mutex);
+    const BlockMetadata source = get_block_metadata(block_id);
+    if (source.file_id == static_cast<short>(target_file_id)) {
+        return absl::OkStatus();
+    }
+    if (!has_room(target_file_id, 0)) {
+        return absl::ResourceExhaustedError(
+            "StorageEngine::migrate_block error: target device is full");
+    }
+
+    auto& block_count_per_file = storage_metadata.block_count_per_file;
+    const BlockMetadata target(
+        target_file_id, block_count_per_file[target_file_id] * block_size);
+    auto res = copy_block(source, target);
+    if (!res.ok()) return res;
+    res = set_block_metadata(block_id, target);
+    if (!res.ok()) return res;
+    block_count_per_file[target_file_id] += 1;
+
+    const BlockMetadata last(
+        source.file_id,
+        (block_count_per_file[source.file_id] - 1) * block_size);
+    if (last.offset != source.offset) {
+        auto find_res = find_block(last.file_id, last.offset);
+        if (!find_res.ok()) return find_res.status();
+        res = copy_block(last, source);
+        if (!res.ok()) return res;
+        res = set_block_metadata(*find_res, source);
+        if (!res.ok()) return res;
+    }
+    block_count_per_file[source.file_id] -= 1;
+    res = storage_metadata.sync_block_counts(storage_metadata_fd);
+    if (!res.ok()) return res;
+    lock.unlock();
+
+    // readers only need the page cache, durability can wait until here
+    if (fdatasync(fd_cache[target_file_id]) != 0 ||
+        fdatasync(fd_cache[source.file_id]) != 0 ||
+        fdatasync(block_metadata_fd) != 0 ||
+        fdatasync(storage_metadata_fd) != 0) {
+        return absl::UnknownError(
+            "StorageEngine::migrate_block error: fdatasync failed");
+    }
+    return absl::OkStatus();
+}
+
 absl::Status StorageEngine::write(char* buffer,
                                   StorageEngine::BlockId block_id) {
-    if (block_id > storage_metadata.block_count()) {
+    std::shared_lock lock(block_table_mutex);
+    if (block_id >= storage_metadata.block_count()) {
         return absl::UnavailableError(
             "StorageEngine::write error: invalid block_id");
     }
@@ -470,12 +1669,30 @@ absl::Status StorageEngine::write(char* buffer,
         return absl::UnavailableError(
             "StorageEngine::write error: Invalid file descriptor");
 
-    WriteBuffer write_buffer(block_size);
-    memcpy(write_buffer.get_buffer(), buffer, block_size);
-    const size_t bytes_written =
-        pwrite(fd, write_buffer.get_buffer(), block_size, block_metadata.offset);
+    size_t bytes_written;
+    const StoredBlock stored_block(buffer, block_size, block_compression);
+    const size_t stored_size = stored_block.size;
+    const auto start = io_stats->begin_io(block_metadata.file_id);
+    if (is_aligned(stored_block.buffer)) {
+        // O_DIRECT can take the caller's buffer (or the encoding) as is
+        bytes_written =
+            pwrite(fd, stored_block.buffer, stored_size, block_metadata.offset);
+    } else {
+        WriteBuffer write_buffer(block_size);
+        memcpy(write_buffer.get_buffer(), buffer, block_size);
+        bytes_written = pwrite(fd, write_buffer.get_buffer(), block_size,
+                               block_metadata.offset);
+    }
+    io_stats->end_write(block_metadata.file_id, start,
+                        (bytes_written == stored_size) ? stored_size : 0);
+    trace(TraceOperation::Write, block_id, block_metadata.file_id, start);
+    if (bytes_written == stored_size) {
+        auto res = update_zone_map(block_id, buffer, stored_block.encoding,
+                                   stored_size);
+        if (!res.ok()) return res;
+    }
 
-    if (bytes_written != block_size)
+    if (bytes_written != stored_size)
         return absl::UnknownError(
             "StorageEngine::write error: number of written bytes is less than "
             "expected");
@@ -483,6 +1700,101 @@ absl::Status StorageEngine::write(char* buffer,
     return absl::OkStatus();
 }
 
+absl::Status StorageEngine::write_blocks(
+    std::span<const StorageEngine::BlockId> block_ids,
+    std::span<char* const> buffers) {
+    if (block_ids.size() != buffers.size()) {
+        return absl::InvalidArgumentError(
+            "StorageEngine::write_blocks error: number of buffers doesn't "
+            "match number of blocks");
+    }
+    std::shared_lock lock(block_table_mutex);
+    const size_t block_count = storage_metadata.block_count();
+    const size_t number_of_files = storage_metadata.number_of_files;
+
+    // (offset, index into block_ids) per device
+    std::vector<std::vector<std::pair<long, size_t>>> writes_per_file(
+        number_of_files);
+    for (size_t i = 0; i < block_ids.size(); ++i) {
+        if (block_ids[i] >= block_count) {
+            return absl::UnavailableError(
+                "StorageEngine::write_blocks error: invalid block_id");
+        }
+        if (!is_aligned(buffers[i])) {
+            return absl::InvalidArgumentError(
+                "StorageEngine::write_blocks error: buffer is not 512-byte "
+                "aligned");
+        }
+        const BlockMetadata block_metadata = get_block_metadata(block_ids[i]);
+        writes_per_file[block_metadata.file_id].emplace_back(
+            block_metadata.offset, i);
+    }
+
+    // a device's writes are merged into pwritev calls over runs of adjacent
+    // offsets; every device is written by its own thread
+    auto write_file = [&](size_t file_id) -> absl::Status {
+        auto& writes = writes_per_file[file_id];
+        std::sort(writes.begin(), writes.end());
+        std::vector<StoredBlock> stored_blocks;
+        stored_blocks.reserve(writes.size());
+        for (const auto& write : writes) {
+            stored_blocks.emplace_back(buffers[write.second], block_size,
+                                       block_compression);
+        }
+        // an encoded block doesn't fill its slot, so it ends the run
+        std::vector<iovec> iovecs;
+        size_t run_start = 0;
+        size_t run_bytes = 0;
+        for (size_t j = 0; j < writes.size(); ++j) {
+            const StoredBlock& stored_block = stored_blocks[j];
+            iovecs.push_back(
+                {const_cast<char*>(stored_block.buffer), stored_block.size});
+            run_bytes += stored_block.size;
+            const bool run_ends =
+                (j + 1 == writes.size() ||
+                 writes[j + 1].first !=
+                     writes[j].first + long(stored_block.size));
+            if (!run_ends) continue;
+            const auto start = io_stats->begin_io(file_id);
+            auto res = pwritev_all(fd_cache[file_id], iovecs,
+                                   writes[run_start].first);
+            io_stats->end_write(file_id, start, res.ok() ? run_bytes : 0);
+            // a run is one pwritev, each of its blocks gets its latency
+            for (size_t k = run_start; k <= j; ++k) {
+                trace(TraceOperation::Write, block_ids[writes[k].second],
+                      file_id, start);
+            }
+            if (!res.ok()) return res;
+            for (size_t k = run_start; k <= j; ++k) {
+                res = update_zone_map(block_ids[writes[k].second],
+                                      buffers[writes[k].second],
+                                      stored_blocks[k].encoding,
+                                      stored_blocks[k].size);
+                if (!res.ok()) return res;
+            }
+            iovecs.clear();
+            run_start = j + 1;
+            run_bytes = 0;
+        }
+        return absl::OkStatus();
+    };
+
+    std::vector<absl::Status> statuses(number_of_files);
+    std::vector<std::thread> threads;
+    for (size_t file_id = 0; file_id < number_of_files; ++file_id) {
+        if (writes_per_file[file_id].empty()) continue;
+        threads.emplace_back(
+            [&, file_id] { statuses[file_id] = write_file(file_id); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto& status : statuses) {
+        if (!status.ok()) return status;
+    }
+    return absl::OkStatus();
+}
+
 std::ostream& operator<<(std::ostream& os,
                          const StorageEngine& storage_engine) {
     os << "Path: " << storage_engine.path << '\n';
@@ -516,6 +1828,121 @@ StorageMetadata StorageEngine::get_metadata() const {
 
 size_t StorageEngine::get_block_size() const { return this->block_size; }
 
+size_t StorageEngine::get_block_count() const {
+    std::shared_lock lock(block_table_mutex);
+    return this->storage_metadata.block_count();
+}
+
+size_t StorageEngine::get_number_of_files() const {
+    return this->storage_metadata.number_of_files;
+}
+
+const DeviceTopology& StorageEngine::get_topology() const { return topology; }
+
+IoStats& StorageEngine::get_io_stats() const { return *io_stats; }
+
+void StorageEngine::set_trace_recorder(
+    std::shared_ptr<TraceRecorder> trace_recorder) {
+    this->trace_recorder = std::move(trace_recorder);
+}
+
+void StorageEngine::trace(TraceOperation operation, BlockId block_id,
+                          size_t file_id,
+                          IoStats::Clock::time_point start) const {
+    if (trace_recorder == nullptr) return;
+    trace_recorder->record(operation, block_id, file_id, start,
+                           IoStats::Clock::now());
+}
+
+void StorageEngine::set_block_compression(bool enabled) {
+    block_compression = enabled;
+}
+
+std::vector<StorageEngine::BlockId> StorageEngine::ColumnInfo::get_block_ids()
+    const {
+    std::vector<BlockId> block_ids(block_count);
+    std::iota(block_ids.begin(), block_ids.end(), first_block);
+    return block_ids;
+}
+
+absl::StatusOr<std::vector<StorageEngine::BlockId>> StorageEngine::create_column(
+    const std::string& name, size_t block_count, ColumnPlacement placement,
+    ValueType value_type, size_t row_count) {
+    if (name.empty() ||
+        std::any_of(name.begin(), name.end(),
+                    [](char c) { return std::isspace(c); })) {
+        return absl::InvalidArgumentError(
+            "StorageEngine::create_column error: column name must be "
+            "nonempty and have no whitespace");
+    }
+    const size_t rows_per_block = block_size / value_size(value_type);
+    if (row_count == size_t(-1)) row_count = block_count * rows_per_block;
+    if (row_count > block_count * rows_per_block) {
+        return absl::InvalidArgumentError(
+            "StorageEngine::create_column error: row_count doesn't fit into "
+            "block_count blocks");
+    }
+    if (get_column(name).ok()) {
+        return absl::AlreadyExistsError(
+            "StorageEngine::create_column error: column " + name +
+            " already exists");
+    }
+
+    ColumnInfo column;
+    column.name = name;
+    column.column_index = columns.size();
+    column.first_block = next_id;
+    column.block_count = block_count;
+    column.placement = placement;
+    column.value_type = value_type;
+    column.row_count = row_count;
+    auto create_res =
+        create_blocks(block_count, [this, &column](BlockId block_id) {
+            return select_column_file(column, block_id - column.first_block);
+        });
+    if (!create_res.ok()) return create_res.status();
+
+    columns.emplace_back(column);
+    auto res = sync_columns();
+    if (!res.ok()) return res;
+    return column.get_block_ids();
+}
+
+absl::StatusOr<StorageEngine::ColumnInfo> StorageEngine::get_column(
+    const std::string& name) const {
+    for (const ColumnInfo& column : columns) {
+        if (column.name == name) return column;
+    }
+    return absl::NotFoundError("StorageEngine::get_column error: no column " +
+                               name);
+}
+
+const std::vector<StorageEngine::ColumnInfo>& StorageEngine::get_columns()
+    const {
+    return columns;
+}
+
+std::filesystem::path StorageEngine::get_columns_path(
+    const std::filesystem::path& path) {
+    return storage_metas_path + path.generic_string() + "_columns";
+}
+
+std::filesystem::path StorageEngine::get_zone_map_path(
+    const std::filesystem::path& path) {
+    return storage_metas_path + path.generic_string() + "_zone_map";
+}
+
+BlockZoneMap StorageEngine::get_zone_map(BlockId block_id) const {
+    std::shared_lock lock(block_table_mutex);
+    if (block_id >= storage_metadata.block_count()) return BlockZoneMap();
+    return zone_maps[block_id];
+}
+
+short StorageEngine::get_block_file_id(BlockId block_id) const {
+    std::shared_lock lock(block_table_mutex);
+    return get_block_metadata(block_id).file_id;
+}
+
 std::filesystem::path StorageMetadata::get_block_metadata() const {
     return this->block_metadata_path;
 }
@@ -0,0 +1,253 @@
+#include <table.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace {
+
+bool is_valid_name(const std::string& name) {
+    return !name.empty() &&
+           std::none_of(name.begin(), name.end(), [](char c) {
+               return c == '.' || std::isspace(c);
+           });
+}
+
+struct AlignedFree {
+    void operator()(char* buffer) const { free(buffer); }
+};
+
+}  // namespace
+
+template <typename T>
+ColumnBlock<T>::ColumnBlock(BlockReader reader, size_t row_count)
+    : reader(std::move(reader)), row_count(row_count) {}
+
+template <typename T>
+std::span<const T> ColumnBlock<T>::values() const {
+    return reader.view<T>().first(row_count);
+}
+
+template <typename T>
+size_t ColumnBlock<T>::get_row_count() const {
+    return row_count;
+}
+
+template <typename T>
+Column<T>::Column(StorageEngine& storage_engine,
+                  const StorageEngine::ColumnInfo& column_info)
+    : storage_engine(&storage_engine),
+      column_info(column_info),
+      rows_per_block(storage_engine.get_block_size() / sizeof(T)) {}
+
+template <typename T>
+absl::StatusOr<Column<T>> Column<T>::open(StorageEngine& storage_engine,
+                                          const std::string& name) {
+    auto column_res = storage_engine.get_column(name);
+    if (!column_res.ok()) return column_res.status();
+    if (column_res->value_type != value_type_of<T>()) {
+        return absl::InvalidArgumentError("Column::open error: column " + name +
+                                          " holds values of another type");
+    }
+    return Column<T>(storage_engine, *column_res);
+}
+
+template <typename T>
+const std::string& Column<T>::get_name() const {
+    return column_info.name;
+}
+
+template <typename T>
+size_t Column<T>::get_row_count() const {
+    return column_info.row_count;
+}
+
+template <typename T>
+size_t Column<T>::get_block_count() const {
+    return column_info.block_count;
+}
+
+template <typename T>
+size_t Column<T>::get_rows_per_block() const {
+    return rows_per_block;
+}
+
+template <typename T>
+size_t Column<T>::get_block_row_count(size_t block) const {
+    const size_t first_row = block * rows_per_block;
+    if (first_row >= column_info.row_count) return 0;
+    return std::min(rows_per_block, column_info.row_count - first_row);
+}
+
+template <typename T>
+StorageEngine::BlockId Column<T>::get_block_id(size_t block) const {
+    return column_info.first_block + block;
+}
+
+template <typename T>
+std::vector<StorageEngine::BlockId> Column<T>::get_block_ids() const {
+    return column_info.get_block_ids();
+}
+
+template <typename T>
+StorageEngine& Column<T>::get_storage_engine() const {
+    return *storage_engine;
+}
+
+template <typename T>
+absl::StatusOr<ColumnBlock<T>> Column<T>::read_block(size_t block) const {
+    if (block >= column_info.block_count) {
+        return absl::OutOfRangeError(
+            "Column::read_block error: block is out of the column");
+    }
+    auto get_block_res = storage_engine->get_block(get_block_id(block));
+    if (!get_block_res.ok()) return get_block_res.status();
+    return ColumnBlock<T>(std::move(get_block_res.value()),
+                          get_block_row_count(block));
+}
+
+template <typename T>
+absl::Status Column<T>::write_block(size_t block, std::span<const T> values) {
+    if (block >= column_info.block_count) {
+        return absl::OutOfRangeError(
+            "Column::write_block error: block is out of the column");
+    }
+    if (values.size() != get_block_row_count(block)) {
+        return absl::InvalidArgumentError(
+            "Column::write_block error: number of values doesn't match the "
+            "row count of the block");
+    }
+    const size_t block_size = storage_engine->get_block_size();
+    std::unique_ptr<char, AlignedFree> buffer(
+        static_cast<char*>(std::aligned_alloc(512, block_size)));
+    if (buffer == nullptr) {
+        return absl::ResourceExhaustedError(
+            "Column::write_block error: aligned_alloc failed");
+    }
+    memset(buffer.get(), 0, block_size);
+    memcpy(buffer.get(), values.data(), values.size_bytes());
+    return storage_engine->write(buffer.get(), get_block_id(block));
+}
+
+template <typename T>
+absl::Status Column<T>::write(std::span<const T> values) {
+    if (values.size() != column_info.row_count) {
+        return absl::InvalidArgumentError(
+            "Column::write error: number of values doesn't match the row "
+            "count of the column");
+    }
+    const size_t block_size = storage_engine->get_block_size();
+    const size_t batch = std::min(kColumnWriteBatch, column_info.block_count);
+    std::unique_ptr<char, AlignedFree> buffer(
+        static_cast<char*>(std::aligned_alloc(512, batch * block_size)));
+    if (batch > 0 && buffer == nullptr) {
+        return absl::ResourceExhaustedError(
+            "Column::write error: aligned_alloc failed");
+    }
+
+    std::vector<StorageEngine::BlockId> block_ids;
+    std::vector<char*> buffers;
+    for (size_t first = 0; first < column_info.block_count; first += batch) {
+        const size_t last = std::min(first + batch, column_info.block_count);
+        block_ids.clear();
+        buffers.clear();
+        for (size_t block = first; block < last; ++block) {
+            char* block_buffer = buffer.get() + (block - first) * block_size;
+            const std::span<const T> block_values = values.subspan(
+                block * rows_per_block, get_block_row_count(block));
+            memcpy(block_buffer, block_values.data(), block_values.size_bytes());
+            // padding of the last block
+            memset(block_buffer + block_values.size_bytes(), 0,
+                   block_size - block_values.size_bytes());
+            block_ids.emplace_back(get_block_id(block));
+            buffers.emplace_back(block_buffer);
+        }
+        auto res = storage_engine->write_blocks(block_ids, buffers);
+        if (!res.ok()) return res;
+    }
+    return absl::OkStatus();
+}
+
+template class ColumnBlock<int32_t>;
+template class ColumnBlock<float>;
+template class ColumnBlock<int64_t>;
+template class Column<int32_t>;
+template class Column<float>;
+template class Column<int64_t>;
+
+Table::Table(StorageEngine& storage_engine, const std::string& name,
+             size_t row_count, const Schema& schema)
+    : storage_engine(&storage_engine),
+      name(name),
+      row_count(row_count),
+      schema(schema) {}
+
+absl::StatusOr<Table> Table::create(StorageEngine& storage_engine,
+                                    const std::string& name, size_t row_count,
+                                    const Schema& schema,
+                                    StorageEngine::ColumnPlacement placement) {
+    if (!is_valid_name(name) || schema.empty()) {
+        return absl::InvalidArgumentError(
+            "Table::create error: invalid table name or empty schema");
+    }
+    for (const auto& [column_name, value_type] : schema) {
+        if (!is_valid_name(column_name)) {
+            return absl::InvalidArgumentError(
+                "Table::create error: invalid column name " + column_name);
+        }
+    }
+    if (open(storage_engine, name).ok()) {
+        return absl::AlreadyExistsError("Table::create error: table " + name +
+                                        " already exists");
+    }
+
+    for (const auto& [column_name, value_type] : schema) {
+        const size_t rows_per_block =
+            storage_engine.get_block_size() / value_size(value_type);
+        const size_t block_count =
+            (row_count + rows_per_block - 1) / rows_per_block;
+        auto create_res = storage_engine.create_column(
+            get_column_name(name, column_name), block_count, placement,
+            value_type, row_count);
+        if (!create_res.ok()) return create_res.status();
+    }
+    return Table(storage_engine, name, row_count, schema);
+}
+
+absl::StatusOr<Table> Table::open(StorageEngine& storage_engine,
+                                  const std::string& name) {
+    const std::string prefix = name + ".";
+    Schema schema;
+    size_t row_count = 0;
+    for (const auto& column : storage_engine.get_columns()) {
+        if (column.name.compare(0, prefix.size(), prefix) != 0) continue;
+        schema.emplace_back(column.name.substr(prefix.size()),
+                            column.value_type);
+        row_count = column.row_count;
+    }
+    if (schema.empty()) {
+        return absl::NotFoundError("Table::open error: no table " + name);
+    }
+    return Table(storage_engine, name, row_count, schema);
+}
+
+std::string Table::get_column_name(const std::string& table_name,
+                                   const std::string& column_name) {
+    return table_name + "." + column_name;
+}
+
+const std::string& Table::get_name() const { return name; }
+
+size_t Table::get_row_count() const { return row_count; }
+
+const Table::Schema& Table::get_schema() const { return schema; }